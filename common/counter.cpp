@@ -5,3 +5,28 @@ void counter::operator += (std::size_t value) noexcept {
     InterlockedAdd64 ((volatile LONG64 *) &this->bytes, value);
     InterlockedIncrement (&this->n);
 }
+
+namespace {
+    DWORD WINAPI defaultGetCurrentProcessorNumber () {
+        return GetCurrentThreadId () >> 2; // thread IDs are multiples of 4
+    }
+    DWORD (WINAPI * pGetCurrentProcessorNumber) () = [] () {
+        if (auto p = GetProcAddress (GetModuleHandle (L"KERNEL32"), "GetCurrentProcessorNumber"))
+            return reinterpret_cast <DWORD (WINAPI *) ()> (p);
+        else
+            return defaultGetCurrentProcessorNumber;
+    } ();
+}
+
+void sharded_counter::operator += (std::size_t value) noexcept {
+    this->shards [pGetCurrentProcessorNumber () % (sizeof this->shards / sizeof this->shards [0])] += value;
+}
+
+counter sharded_counter::load () const noexcept {
+    counter total;
+    for (const auto & shard : this->shards) {
+        total.n += shard.n;
+        total.bytes += shard.bytes;
+    }
+    return total;
+}
@@ -14,6 +14,22 @@ struct counter {
     void operator += (std::size_t value) noexcept;
 };
 
+// sharded_counter
+//  - 'counter' split into per-CPU cache line sized shards, for global statistics
+//    incremented from many threads at once, which would otherwise contend for single cache line
+//  - reads aggregate all shards and are thus only approximate while updates are in progress
+//
+class sharded_counter {
+    struct alignas (64) shard : counter {};
+    shard shards [16];
+
+public:
+    void operator += (std::size_t value) noexcept;
+
+    counter load () const noexcept;
+    operator counter () const noexcept { return this->load (); }
+};
+
 // translate
 //  - for passing Counters as a log function parameter
 //
@@ -31,5 +47,8 @@ inline std::wstring translate (counter c, const std::wstring &) {
                    c.n, (v < 10.0 && c.bytes > 10), v, prefix [m], (m != 0) ? L"B" : L"");
     return number;
 }
+inline std::wstring translate (const sharded_counter & c, const std::wstring & format) {
+    return translate (c.load (), format);
+}
 
 #endif
@@ -1,10 +1,12 @@
 #include "file.h"
-#include <winioctl.h>
 
 file::~file () {
     this->close ();
 }
 
+#ifdef _WIN32
+#include <winioctl.h>
+
 bool file::open (const wchar_t * path, mode m, access a, share s, buffer buffering) noexcept {
     HANDLE h = CreateFile (path, (DWORD) a, (DWORD) s,
                            NULL, (DWORD) m, (DWORD) buffering, NULL);
@@ -77,6 +79,19 @@ bool file::write (const void * data, std::size_t size) noexcept {
         && written == size;
 }
 
+bool file::write (std::uintmax_t offset, const void * data, std::size_t size) noexcept {
+    DWORD written;
+    OVERLAPPED o;
+
+    o.hEvent = NULL;
+    o.Offset = offset & 0xFFFFFFFF;
+    o.OffsetHigh = offset >> 32;
+
+    return size <= MAXDWORD
+        && WriteFile (this->handle, data, (DWORD) size, &written, &o)
+        && written == size;
+}
+
 bool file::read (void * data, std::size_t size) noexcept {
     static const auto chunk = 0x8000'0000;
 
@@ -131,3 +146,300 @@ bool file::zero (std::uintmax_t offset, std::uintmax_t length) noexcept {
 bool file::unlink (const std::wstring & path) {
     return DeleteFile (path.c_str ());
 }
+
+bool file::rename (const std::wstring & from, const std::wstring & to) {
+    return MoveFileEx (from.c_str (), to.c_str (), MOVEFILE_REPLACE_EXISTING);
+}
+
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <cerrno>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
+
+namespace {
+
+    // narrow
+    //  - converts wide path to UTF-8 for POSIX APIs
+    //
+    std::string narrow (const wchar_t * path) {
+        std::string result;
+        for (; *path; ++path) {
+            auto c = (std::uint32_t) *path;
+
+            if (c >= 0xD800 && c < 0xDC00 && path [1] >= 0xDC00 && path [1] < 0xE000) {
+                c = 0x10000 + ((c - 0xD800) << 10) + ((std::uint32_t) *++path - 0xDC00);
+            }
+            if (c < 0x80) {
+                result += (char) c;
+            } else
+            if (c < 0x800) {
+                result += (char) (0xC0 | (c >> 6));
+                result += (char) (0x80 | (c & 0x3F));
+            } else
+            if (c < 0x10000) {
+                result += (char) (0xE0 | (c >> 12));
+                result += (char) (0x80 | ((c >> 6) & 0x3F));
+                result += (char) (0x80 | (c & 0x3F));
+            } else {
+                result += (char) (0xF0 | (c >> 18));
+                result += (char) (0x80 | ((c >> 12) & 0x3F));
+                result += (char) (0x80 | ((c >> 6) & 0x3F));
+                result += (char) (0x80 | (c & 0x3F));
+            }
+        }
+        return result;
+    }
+}
+
+bool file::open (const wchar_t * path, mode m, access a, share s, buffer buffering) noexcept {
+    int flags = O_CLOEXEC;
+    switch (a) {
+        case access::query:
+        case access::read:
+            flags |= O_RDONLY;
+            break;
+        case access::write:
+            flags |= O_RDWR;
+            break;
+    }
+    switch (m) {
+        case mode::open:
+            break;
+        case mode::always:
+            flags |= O_CREAT;
+            break;
+        case mode::create:
+            flags |= O_CREAT | O_TRUNC;
+            break;
+    }
+
+    try {
+        const auto name = narrow (path);
+
+        // 'created' reports whether 'always' created the file, so try exclusive creation first
+
+        bool fresh = false;
+        int fd = -1;
+        if (m == mode::always) {
+            fd = ::open (name.c_str (), flags | O_EXCL, 0644);
+            fresh = (fd != -1);
+        }
+        if (fd == -1) {
+            fd = ::open (name.c_str (), flags, 0644);
+        }
+        if (fd == -1)
+            return false;
+
+        if (s == share::none) {
+            if (flock (fd, LOCK_EX | LOCK_NB) != 0) {
+                ::close (fd);
+                return false;
+            }
+        }
+
+#if defined (POSIX_FADV_NORMAL)
+        switch (buffering) {
+            case buffer::none:
+                posix_fadvise (fd, 0, 0, POSIX_FADV_NOREUSE);
+                break;
+            case buffer::normal:
+            case buffer::temporary:
+                break;
+            case buffer::random:
+                posix_fadvise (fd, 0, 0, POSIX_FADV_RANDOM);
+                break;
+            case buffer::sequential:
+                posix_fadvise (fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+                break;
+        }
+#endif
+        this->close ();
+        this->handle = fd;
+        this->fresh = fresh;
+        return true;
+
+    } catch (const std::bad_alloc &) {
+        return false;
+    }
+}
+
+bool file::compress () noexcept {
+#if defined (__linux__) && defined (FS_IOC_SETFLAGS)
+    int attributes = 0;
+    if (ioctl (this->handle, FS_IOC_GETFLAGS, &attributes) == 0) {
+        attributes |= FS_COMPR_FL;
+        return ioctl (this->handle, FS_IOC_SETFLAGS, &attributes) == 0;
+    }
+#endif
+    return false;
+}
+
+void file::close () noexcept {
+    if (this->handle != invalid) {
+        ::close (this->handle);
+        this->handle = invalid;
+    }
+}
+
+void file::flush () const noexcept {
+    if (!this->closed ()) {
+        fsync (this->handle);
+    }
+}
+
+std::uintmax_t file::seek_ (std::uintmax_t offset, int whence) const noexcept {
+    const auto result = lseek (this->handle, (off_t) offset, whence);
+    if (result != (off_t) -1)
+        return (std::uintmax_t) result;
+    else
+        return (std::uintmax_t) -1;
+}
+
+std::uintmax_t file::seek (std::uintmax_t offset) noexcept {
+    return this->seek_ (offset, SEEK_SET);
+}
+std::uintmax_t file::tail () noexcept {
+    return this->seek_ (0, SEEK_END);
+}
+std::uintmax_t file::tell () const noexcept {
+    return this->seek_ (0, SEEK_CUR);
+}
+
+std::uintmax_t file::size () const noexcept {
+    struct stat result;
+    if (fstat (this->handle, &result) == 0)
+        return (std::uintmax_t) result.st_size;
+    else
+        return (std::uintmax_t) -1;
+}
+
+bool file::resize (std::uintmax_t length) noexcept {
+
+    // extending allocates the space right away, like SetEndOfFile does on NTFS,
+    // falling back to sparse extension where the filesystem doesn't support 'fallocate'
+
+    const auto size = this->size ();
+    if (size == (std::uintmax_t) -1)
+        return false;
+
+#ifdef __linux__
+    if (length > size) {
+        if (fallocate (this->handle, 0, (off_t) size, (off_t) (length - size)) == 0)
+            return this->seek (length) != (std::uintmax_t) -1;
+    }
+#endif
+    return ftruncate (this->handle, (off_t) length) == 0
+        && this->seek (length) != (std::uintmax_t) -1;
+}
+
+bool file::write (const void * data, std::size_t size) noexcept {
+    while (size) {
+        const auto n = ::write (this->handle, data, size);
+        if (n > 0) {
+            size -= (std::size_t) n;
+            data = reinterpret_cast <const char *> (data) + n;
+        } else
+        if (n == -1 && errno == EINTR) {
+            continue;
+        } else
+            return false;
+    }
+    return true;
+}
+
+bool file::write (std::uintmax_t offset, const void * data, std::size_t size) noexcept {
+    while (size) {
+        const auto n = pwrite (this->handle, data, size, (off_t) offset);
+        if (n > 0) {
+            size -= (std::size_t) n;
+            offset += (std::size_t) n;
+            data = reinterpret_cast <const char *> (data) + n;
+        } else
+        if (n == -1 && errno == EINTR) {
+            continue;
+        } else
+            return false;
+    }
+    return true;
+}
+
+bool file::read (void * data, std::size_t size) noexcept {
+    while (size) {
+        const auto n = ::read (this->handle, data, size);
+        if (n > 0) {
+            size -= (std::size_t) n;
+            data = reinterpret_cast <char *> (data) + n;
+        } else
+        if (n == -1 && errno == EINTR) {
+            continue;
+        } else
+            return false; // including end of file
+    }
+    return true;
+}
+
+bool file::read (std::uintmax_t offset, void * data, std::size_t size) noexcept {
+    while (size) {
+        const auto n = pread (this->handle, data, size, (off_t) offset);
+        if (n > 0) {
+            size -= (std::size_t) n;
+            offset += (std::size_t) n;
+            data = reinterpret_cast <char *> (data) + n;
+        } else
+        if (n == -1 && errno == EINTR) {
+            continue;
+        } else
+            return false; // including end of file
+    }
+    return true;
+}
+
+bool file::zero (std::uintmax_t offset, std::uintmax_t length) noexcept {
+
+    // deallocate the range, or write zeros if the filesystem can't punch holes
+
+#if defined (__linux__) && defined (FALLOC_FL_PUNCH_HOLE)
+    if (fallocate (this->handle, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, (off_t) offset, (off_t) length) == 0)
+        return true;
+#endif
+    static const char zeros [4096] = {};
+    while (length) {
+        const auto n = (std::size_t) ((length < sizeof zeros) ? length : sizeof zeros);
+        if (!this->write (offset, zeros, n))
+            return false;
+
+        offset += n;
+        length -= n;
+    }
+    return true;
+}
+
+bool file::unlink (const std::wstring & path) {
+    try {
+        return ::unlink (narrow (path.c_str ()).c_str ()) == 0;
+    } catch (const std::bad_alloc &) {
+        return false;
+    }
+}
+
+bool file::rename (const std::wstring & from, const std::wstring & to) {
+    try {
+        const auto source = narrow (from.c_str ());
+        const auto target = narrow (to.c_str ());
+#if defined (__linux__) && defined (RENAME_NOREPLACE)
+        return renameat2 (AT_FDCWD, source.c_str (), AT_FDCWD, target.c_str (), 0) == 0;
+#else
+        return ::rename (source.c_str (), target.c_str ()) == 0;
+#endif
+    } catch (const std::bad_alloc &) {
+        return false;
+    }
+}
+#endif
@@ -1,17 +1,34 @@
 #ifndef RADDI_FILE_H
 #define RADDI_FILE_H
 
-#include <windows.h>
 #include <string>
+#include <cstdint>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
 
 // file
 //  - simple filesystem file abstraction for future porting
 //  - at this point mostly to simplify destruction
+//  - on POSIX systems implemented on file descriptor with pread/pwrite, fallocate, posix_fadvise
+//    and renameat2 where available, paths are converted to UTF-8
 //
 class file {
-    HANDLE handle;
+#ifdef _WIN32
+    typedef HANDLE descriptor;
+    static inline const descriptor invalid = INVALID_HANDLE_VALUE;
+#else
+    typedef int descriptor;
+    static inline const descriptor invalid = -1;
+#endif
+    descriptor handle;
+#ifndef _WIN32
+    bool fresh = false; // see 'created'
+#endif
 
 public:
+#ifdef _WIN32
     enum class access : DWORD {
         query = FILE_READ_ATTRIBUTES,
         read  = GENERIC_READ,
@@ -34,16 +51,45 @@ public:
         always = OPEN_ALWAYS,
         create = CREATE_ALWAYS,
     };
+#else
+    // POSIX
+    //  - options are translated to 'open' flags when opening
+    //  - there are no share modes, 'none' takes advisory exclusive lock (flock)
+    //  - buffering options are translated to 'posix_fadvise' advice
+    //
+    enum class access : int {
+        query,
+        read,
+        write,
+    };
+    enum class share : int {
+        none,
+        read,
+        full,
+    };
+    enum class buffer : int {
+        none,
+        normal,
+        random,
+        temporary,
+        sequential,
+    };
+    enum class mode : int {
+        open,
+        always,
+        create,
+    };
+#endif
 
 public:
-    file () : handle (INVALID_HANDLE_VALUE) {};
+    file () : handle (invalid) {};
     file (file && other) noexcept : handle (other.handle) {
-        other.handle = INVALID_HANDLE_VALUE;
+        other.handle = invalid;
     }
     file & operator = (file && other) noexcept {
         this->close ();
         this->handle = other.handle;
-        other.handle = INVALID_HANDLE_VALUE;
+        other.handle = invalid;
         return *this;
     }
     ~file ();
@@ -69,14 +115,18 @@ public:
     //  - must be called immediately after 'open' otherwise result is undefined
     //
     bool created () const noexcept {
+#ifdef _WIN32
         return GetLastError () == 0;
+#else
+        return this->fresh;
+#endif
     }
 
     // close
     //  - release the file handle
     //
     void close () noexcept;
-    bool closed () const noexcept { return this->handle == INVALID_HANDLE_VALUE; }
+    bool closed () const noexcept { return this->handle == invalid; }
     void flush () const noexcept;
 
     // seek/tail/tell
@@ -119,10 +169,11 @@ public:
     }
 
     // write
-    //  - writes 'size' bytes from 'data' into the file's current position
-    //    possibly extending the file size
+    //  - writes 'size' bytes from 'data' into the file's current position,
+    //    or at provided offset, possibly extending the file size
     //
     bool write (const void * data, std::size_t size) noexcept;
+    bool write (std::uintmax_t offset, const void * data, std::size_t size) noexcept;
 
     template <typename T>
     bool write (const T & object) noexcept {
@@ -141,6 +192,11 @@ public:
     //
     static bool unlink (const std::wstring & path);
 
+    // rename
+    //  - moves file to new path, replacing existing file there
+    //
+    static bool rename (const std::wstring & from, const std::wstring & to);
+
 private:
     std::uintmax_t seek_ (std::uintmax_t offset, int) const noexcept;
 };
@@ -1,5 +1,6 @@
 #include "lock.h"
 
+#ifdef _WIN32
 namespace {
     void WINAPI defaultCsInit (void ** object) {
         auto cs = new CRITICAL_SECTION;
@@ -56,3 +57,110 @@ bool lock::initialize () noexcept {
     pInit = defaultCsInit;
     return false;
 }
+
+std::uint32_t biased_lock::thread () noexcept {
+    return GetCurrentThreadId ();
+}
+
+std::int64_t biased_lock::counter () noexcept {
+    LARGE_INTEGER t;
+    QueryPerformanceCounter (&t);
+    return t.QuadPart;
+}
+
+void biased_lock::pause (unsigned int spin) noexcept {
+    if (spin < 64) {
+        YieldProcessor ();
+    } else {
+        SwitchToThread ();
+    }
+}
+
+#else
+#include <chrono>
+#include <thread>
+
+std::uint32_t biased_lock::thread () noexcept {
+    static std::atomic <std::uint32_t> sequence { 0 };
+    static thread_local const std::uint32_t id = ++sequence; // never 0, 0 means no owner
+    return id;
+}
+
+std::int64_t biased_lock::counter () noexcept {
+    return std::chrono::steady_clock::now ().time_since_epoch ().count ();
+}
+
+void biased_lock::pause (unsigned int spin) noexcept {
+    if (spin >= 64) {
+        std::this_thread::yield ();
+    }
+}
+#endif
+
+biased_lock::slot biased_lock::readers [512] = {};
+
+biased_lock::slot & biased_lock::select (std::uint32_t thread) noexcept {
+    auto h = reinterpret_cast <std::uintptr_t> (this) / alignof (biased_lock);
+    h ^= thread * 0x9E3779B9u;
+    h ^= h >> 13;
+    return readers [h % (sizeof readers / sizeof readers [0])];
+}
+
+void biased_lock::acquire_shared () noexcept {
+    if (this->bias.load (std::memory_order_acquire)) {
+        const auto thread = biased_lock::thread ();
+        auto & slot = this->select (thread);
+
+        biased_lock * expected = nullptr;
+        if (slot.lock.compare_exchange_strong (expected, this)) {
+
+            // recheck after publishing, writer might have revoked the bias meanwhile
+
+            if (this->bias.load ()) {
+                slot.owner.store (thread, std::memory_order_relaxed);
+                return;
+            }
+            slot.lock.store (nullptr, std::memory_order_release);
+        }
+    }
+
+    this->underlying.acquire_shared ();
+
+    if (!this->bias.load (std::memory_order_relaxed)
+            && (counter () >= this->inhibited.load (std::memory_order_relaxed))) {
+        this->bias.store (true);
+    }
+}
+
+void biased_lock::release_shared () noexcept {
+    const auto thread = biased_lock::thread ();
+    auto & slot = this->select (thread);
+
+    // owner is cleared before the slot is, so it matches only our own fast path acquisition
+
+    if (slot.lock.load (std::memory_order_relaxed) == this
+            && slot.owner.load (std::memory_order_relaxed) == thread) {
+
+        slot.owner.store (0, std::memory_order_relaxed);
+        slot.lock.store (nullptr, std::memory_order_release);
+    } else {
+        this->underlying.release_shared ();
+    }
+}
+
+void biased_lock::acquire_exclusive () noexcept {
+    this->underlying.acquire_exclusive ();
+
+    if (this->bias.load (std::memory_order_relaxed)) {
+        this->bias.store (false);
+
+        const auto t0 = counter ();
+        for (auto & slot : readers) {
+            for (auto spin = 0u; slot.lock.load () == this; ++spin) {
+                pause (spin);
+            }
+        }
+        const auto t1 = counter ();
+        this->inhibited.store (t1 + (t1 - t0) * inhibition, std::memory_order_relaxed);
+    }
+}
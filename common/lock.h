@@ -1,8 +1,15 @@
 #ifndef RADDI_LOCK_H
 #define RADDI_LOCK_H
 
+#include <atomic>
+#include <cstdint>
+
+#ifdef _WIN32
 #include <windows.h>
 
+// lock
+//  - SRW lock, or critical section on systems that don't have it (XP)
+//
 class lock {
     void * srw = nullptr;
     
@@ -29,10 +36,80 @@ private:
     lock & operator = (const lock &) = delete;
 };
 
+#else
+#include <shared_mutex>
+
+// lock
+//  - portable equivalent of the SRW lock wrapper, same semantics
+//
+class lock {
+    std::shared_mutex srw;
+
+public:
+    static bool initialize () noexcept { return true; }
+public:
+    lock () noexcept = default;
+
+    void acquire_shared () noexcept { this->srw.lock_shared (); }
+    void release_shared () noexcept { this->srw.unlock_shared (); }
+
+    void acquire_exclusive () noexcept { this->srw.lock (); }
+    void release_exclusive () noexcept { this->srw.unlock (); }
+
+private:
+    lock (const lock &) = delete;
+    lock & operator = (const lock &) = delete;
+};
+
+#endif
+
+// biased_lock
+//  - reader-biased variant of 'lock' for read-mostly structures (BRAVO algorithm)
+//  - while biased, readers only publish themselves in a global table of visible readers,
+//    a slot selected by hash of thread and lock, instead of all writing the lock's cache line
+//  - writer revokes the bias and waits for visible readers to drain; the bias is then
+//    inhibited for a time proportional to how long the revocation took
+//  - revocation scans the whole table of visible readers, use only where exclusive
+//    acquisitions are rare, otherwise plain 'lock' is cheaper
+//  - NOTE: shared acquire and release must happen on the same thread, and just like
+//          with SRW lock, shared acquisitions must not be nested
+//
+class biased_lock {
+    struct alignas (16) slot {
+        std::atomic <biased_lock *>  lock;
+        std::atomic <std::uint32_t>  owner;
+    };
+    static slot readers [512]; // 8 kB, enough to rarely collide for all workers and biased locks
+    static constexpr auto inhibition = 9u; // multiplier of revocation time
+
+    ::lock underlying;
+    std::atomic <bool> bias { false };
+    std::atomic <std::int64_t> inhibited { 0 }; // counter value until which bias is not set again
+
+    slot & select (std::uint32_t thread) noexcept;
+    static std::uint32_t thread () noexcept;
+    static std::int64_t counter () noexcept;
+    static void pause (unsigned int spin) noexcept;
+
+public:
+    biased_lock () noexcept = default;
+
+    void acquire_shared () noexcept;
+    void release_shared () noexcept;
+
+    void acquire_exclusive () noexcept;
+    void release_exclusive () noexcept { this->underlying.release_exclusive (); }
+
+private:
+    biased_lock (const biased_lock &) = delete;
+    biased_lock & operator = (const biased_lock &) = delete;
+};
+
+template <typename Lock>
 class immutability {
-    lock & ref;
+    Lock & ref;
 public:
-    explicit immutability (lock & ref) noexcept : ref (ref) {
+    explicit immutability (Lock & ref) noexcept : ref (ref) {
         this->ref.acquire_shared ();
     }
     ~immutability () noexcept {
@@ -40,10 +117,11 @@ public:
     }
 };
 
+template <typename Lock>
 class exclusive {
-    lock & ref;
+    Lock & ref;
 public:
-    explicit exclusive (lock & ref) noexcept : ref (ref) {
+    explicit exclusive (Lock & ref) noexcept : ref (ref) {
         this->ref.acquire_exclusive ();
     }
     ~exclusive () noexcept {
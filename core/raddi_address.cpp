@@ -55,6 +55,19 @@ bool raddi::address::operator == (const raddi::address & other) const {
                         sizeof (address::family) + std::min (this->size (), other.size ())) == 0;
 }
 
+std::uint64_t raddi::address::hash () const {
+    const auto * p = reinterpret_cast <const std::uint8_t *> (this);
+    const auto * e = p + sizeof (address::family) + this->size ();
+
+    // FNV-1a
+    std::uint64_t h = 0xcbf29ce484222325uLL;
+    for (; p != e; ++p) {
+        h ^= *p;
+        h *= 0x00000100000001B3uLL;
+    }
+    return h ^ (h >> 32);
+}
+
 raddi::address::address (const sockaddr * addr)
     : family (addr->sa_family) {
 
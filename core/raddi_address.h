@@ -6,6 +6,7 @@
 
 #include <cstddef>
 #include <string>
+#include <functional>
 
 #include "../common/log.h"
 
@@ -35,6 +36,13 @@ namespace raddi {
         bool operator <= (const address & other) const { return !(other < *this); }
         bool operator != (const address & other) const { return !(other == *this); }
 
+        // hash
+        //  - for unordered containers, covers only bytes significant for the family
+        //    (consistent with operator ==)
+        //  - full 64-bit FNV-1a regardless of platform, also used by peerset's Bloom filter
+        //
+        std::uint64_t hash () const;
+
     public:
         static std::size_t size (int family);
         static std::wstring name (int family);
@@ -75,4 +83,10 @@ namespace raddi {
     }
 }
 
+namespace std {
+    template <> struct hash <raddi::address> {
+        std::size_t operator () (const raddi::address & a) const { return (std::size_t) a.hash (); }
+    };
+}
+
 #endif
@@ -1,9 +1,13 @@
 #include "raddi_connection.h"
 #include "raddi_entry.h"
 #include <algorithm>
+#include <memory>
 #include <set>
+#include <lzma.h>
 
 raddi::address raddi::socks5proxy;
+bool raddi::batch_compression = true;
+unsigned int raddi::batch_compression_level = 1;
 
 namespace {
     template <typename T>
@@ -15,6 +19,58 @@ namespace {
         a.port = 0;
         return a;
     }
+
+    // batch_filters
+    //  - raw LZMA2 filter chain for batch frames, those never exceed 64 kB so small dictionary suffices
+    //
+    bool batch_filters (lzma_filter (&filters) [2], lzma_options_lzma & options, std::uint32_t preset) {
+        if (lzma_lzma_preset (&options, preset))
+            return false;
+
+        options.dict_size = 65536;
+        filters [0].id = LZMA_FILTER_LZMA2;
+        filters [0].options = &options;
+        filters [1].id = LZMA_VLI_UNKNOWN;
+        filters [1].options = nullptr;
+        return true;
+    }
+
+    // batch_encoder
+    //  - LZMA2 encoder and output buffer reused for all batches compressed by the thread,
+    //    reinitializing encoder of the same filter chain reuses its memory (dictionary, match finder)
+    //  - per thread, not per connection, since 'dispatch' runs on worker threads and encoder state
+    //    is large compared to what thousands of mostly idle connections would need
+    //
+    struct batch_encoder {
+        lzma_stream stream = LZMA_STREAM_INIT;
+        std::unique_ptr <unsigned char []> output;
+
+        ~batch_encoder () { lzma_end (&this->stream); }
+    };
+    thread_local batch_encoder encoder;
+
+    // scratch
+    //  - per thread buffer of maximal payload size, allocated on first use, replaces 64 kB arrays
+    //    that would otherwise pile up on worker thread stack as the calls nest: 'inbound' decodes
+    //    frame into one, 'unpack' copies each entry into another, and delivering the entry may
+    //    end up sending to connections and packing a batch in 'dispatch', thus one per purpose
+    //
+    struct scratch {
+        std::unique_ptr <unsigned char []> data;
+
+        unsigned char * get () {
+            if (!this->data) {
+                this->data.reset (new (std::nothrow) unsigned char [raddi::protocol::max_payload]);
+            }
+            return this->data.get ();
+        }
+    };
+    static_assert (alignof (raddi::entry) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+
+    thread_local scratch decoded; // 'inbound'
+    thread_local scratch inflated; // 'decompress'
+    thread_local scratch unpacked; // 'unpack'
+    thread_local scratch batched; // 'dispatch'
 }
 
 raddi::connection::connection (Socket && s, const sockaddr * addr, raddi::level level)
@@ -34,6 +90,8 @@ raddi::connection::connection (const address & addr, raddi::level level)
     , level (level) {}
 
 raddi::connection::~connection () {
+    sodium_memzero (this->resumption, sizeof this->resumption);
+
     if (this->secured) {
         delete this->encryption;
         this->encryption = nullptr;
@@ -44,6 +102,8 @@ raddi::connection::~connection () {
 }
 
 bool raddi::connection::connected () {
+    this->tally ();
+
     std::size_t prologue;
     if (socks5proxy.port && this->peer.accessible ()) { // accessible is false for inbound connections
         prologue = 7 + this->peer.size ();
@@ -74,7 +134,19 @@ bool raddi::connection::connected () {
             buffer [prologue - 2] = this->peer.port / 256;
             buffer [prologue - 1] = this->peer.port % 256;
         }
-        this->proposal->propose (reinterpret_cast <raddi::protocol::keyset *> (buffer + prologue));
+
+        // outbound connection may resume previous session with this peer
+
+        raddi::protocol::ticket ticket;
+        std::uint8_t secret [raddi::protocol::resumption::secret_size];
+
+        if (this->is_outbound () && this->resumable (&ticket, secret)) {
+            this->proposal->propose (reinterpret_cast <raddi::protocol::keyset *> (buffer + prologue), &ticket, secret);
+            this->resuming = true;
+            sodium_memzero (secret, sizeof secret);
+        } else {
+            this->proposal->propose (reinterpret_cast <raddi::protocol::keyset *> (buffer + prologue));
+        }
         return this->transmit (buffer, sizeof (raddi::protocol::keyset) + prologue);
     } else
         return false;
@@ -88,31 +160,368 @@ void raddi::connection::overloaded () {
         }
 }
 
-bool raddi::connection::send (const void * data, std::size_t size) {
+bool raddi::connection::send (const void * data, std::size_t size, priority p) {
     if (size > raddi::protocol::max_payload)
         return false;
 
-    // TODO: add multiple queues and prioritize smaller entries before larger ones,
-    //       but sort by size only entries with the same timestamp (send older first)
-    //     - queue priorities:
-    //          1) new identities transmitted first
-    //          2) new channels transmitted second
-    //          3) responses to requests next
-    //          4) new data queued last, ordered by size?
-    //     - queues will need to feature millisecond delay mark
-
     // transmitter lock is required except in 'connected' and 'overloaded'
 
     exclusive guard (this->Transmitter::lock);
-    if (auto message = this->prepare (size + raddi::protocol::frame_overhead)) {
-        auto length = this->encryption->encode (message, size + raddi::protocol::frame_overhead,
+
+    // nothing is waiting, encode directly
+
+    if ((this->backlog == 0) && (this->unsynchronized_buffer_size () < connection::watermark)) {
+        return this->encode (data, size);
+    }
+
+    if (this->overflows (size, p))
+        return false;
+
+    try {
+        connection::append (this->queues [(std::size_t) p], data, size);
+        this->backlog += size;
+
+    } catch (const std::bad_alloc &) {
+        this->counters.oom += size;
+        return false;
+    }
+
+    this->dispatch ();
+    return true;
+}
+
+int raddi::connection::delay (const void * data, std::size_t size, priority p) {
+    if (size > raddi::protocol::max_payload)
+        return -1;
+
+    exclusive guard (this->Transmitter::lock);
+
+    if (this->overflows (size, p))
+        return -1;
+
+    try {
+        connection::append (this->delayed [(std::size_t) p], data, size);
+
+    } catch (const std::bad_alloc &) {
+        this->counters.oom += size;
+        return -1;
+    }
+
+    const bool first = (this->deferred == 0);
+    this->deferred += size;
+    return first;
+}
+
+void raddi::connection::release () {
+    exclusive guard (this->Transmitter::lock);
+
+    if (this->deferred) {
+        try {
+            for (auto c = 0u; c != priorities; ++c) {
+                auto & d = this->delayed [c];
+                auto & q = this->queues [c];
+
+                if (!d.data.empty ()) {
+                    if (q.head == q.data.size ()) {
+                        std::swap (q.data, d.data);
+                        q.head = 0;
+                    } else {
+                        q.data.insert (q.data.end (), d.data.begin (), d.data.end ());
+                    }
+                    d.data.clear ();
+                }
+            }
+        } catch (const std::bad_alloc &) {
+
+            // frames that couldn't be moved are dropped
+
+            for (auto & d : this->delayed) {
+                for (std::size_t i = 0; i != d.data.size (); ) {
+                    const std::size_t size = d.data [i + 0]
+                                          | (d.data [i + 1] << 8);
+                    i += sizeof (std::uint16_t) + size;
+
+                    this->deferred -= size;
+                    this->counters.oom += size;
+                }
+                d.data.clear ();
+            }
+        }
+
+        this->backlog += this->deferred;
+        this->deferred = 0;
+        this->dispatch ();
+    }
+}
+
+void raddi::connection::append (queue & q, const void * data, std::size_t size) {
+    auto offset = q.data.size ();
+
+    q.data.resize (offset + sizeof (std::uint16_t) + size);
+    q.data [offset + 0] = (size >> 0) & 0xFF;
+    q.data [offset + 1] = (size >> 8) & 0xFF;
+    std::memcpy (&q.data [offset + sizeof (std::uint16_t)], data, size);
+}
+
+bool raddi::connection::overflows (std::size_t size, priority p) {
+    if (Transmitter::limit && (this->backlog + this->deferred + this->unsynchronized_buffer_size () + size > Transmitter::limit)) {
+
+        // bulk responses are generated by us, in large amounts at once, overflowing with them
+        // doesn't mean the peer is slow, the response is cut short instead and the caller stops
+
+        if (p != priority::bulk) {
+            this->congested ();
+        }
+        return true;
+    } else
+        return false;
+}
+
+bool raddi::connection::encode (const void * data, std::size_t size, bool immediate) {
+    const auto prepared = size + raddi::protocol::frame_overhead;
+    if (auto message = this->prepare (prepared)) {
+        auto length = this->encryption->encode (message, prepared,
                                                 static_cast <const unsigned char *> (data), size);
-        return this->transmit (message, length);
+        if (immediate) {
+            return this->transmit (message, length);
+        } else {
+            this->commit (message, length);
+            return true;
+        }
+    } else {
+        if (this->unsynchronized_is_congested (prepared)) {
+            this->congested ();
+        }
+        return false;
+    }
+}
+
+void raddi::connection::congested () {
+
+    // peer doesn't read fast enough (or at all), disconnect it to free resources
+
+    if ((SOCKET) *this != INVALID_SOCKET) {
+        this->report (log::level::event, 9, Transmitter::limit);
+        this->cancel ();
+    }
+}
+
+void raddi::connection::dispatch () {
+    static const unsigned int weights [priorities] = { 8, 4, 2, 1 };
+    const auto batch = batched.get ();
+    bool encoded = false;
+
+    // frames are only committed here and passed to a single WSASend at the end
+
+    while (this->backlog && (this->unsynchronized_buffer_size () < connection::watermark)) {
+        for (auto c = 0u; c != priorities; ++c) {
+            auto & q = this->queues [c];
+
+            for (auto i = 0u; (i != weights [c]) && (q.head != q.data.size ()); ++i) {
+                const unsigned char * payload;
+                std::size_t size;
+
+                if (this->batching && batch && (size = this->pack (q, batch))) {
+                    payload = batch;
+
+                    if (this->compression.enabled && raddi::batch_compression) {
+                        if (auto n = this->compress (batch, size, &payload)) {
+                            size = n;
+                        }
+                    }
+                } else {
+                    size = q.data [q.head + 0]
+                         | (q.data [q.head + 1] << 8);
+                    payload = &q.data [q.head + sizeof (std::uint16_t)];
+
+                    q.head += sizeof (std::uint16_t) + size;
+                    this->backlog -= size;
+                }
+
+                if (this->encode (payload, size, false)) {
+                    encoded = true;
+                } else {
+                    for (auto & x : this->queues) {
+                        x.data.clear ();
+                        x.head = 0;
+                    }
+                    this->backlog = 0;
+                }
+            }
+
+            if (q.head == q.data.size ()) {
+                q.data.clear ();
+                q.head = 0;
+
+                if (q.data.capacity () > connection::watermark) {
+                    q.data.shrink_to_fit ();
+                }
+            }
+        }
+    }
+
+    if (encoded) {
+        this->flush ();
+    }
+}
+
+std::size_t raddi::connection::pack (queue & q, unsigned char * batch) {
+    auto frame = [&q] (std::size_t offset) -> std::size_t {
+        return sizeof (std::uint16_t) + (q.data [offset + 0] | (q.data [offset + 1] << 8));
+    };
+
+    // batch only if at least two frames fit
+
+    const auto first = frame (q.head);
+    if (q.head + first == q.data.size ())
+        return 0;
+    if (connection::batch_marker + first + frame (q.head + first) > raddi::protocol::max_payload)
+        return 0;
+
+    // frames are copied including their length prefix
+
+    std::size_t length = connection::batch_marker;
+    std::memcpy (batch, connection::batch_mark, connection::batch_marker);
+
+    while (q.head != q.data.size ()) {
+        const auto size = frame (q.head);
+        if (length + size > raddi::protocol::max_payload)
+            break;
+
+        std::memcpy (&batch [length], &q.data [q.head], size);
+        length += size;
+
+        q.head += size;
+        this->backlog -= size - sizeof (std::uint16_t);
+    }
+    return length;
+}
+
+std::size_t raddi::connection::compress (const unsigned char * batch, std::size_t size, const unsigned char ** result) {
+    const auto t = raddi::microtimestamp ();
+
+    if (!encoder.output) {
+        encoder.output.reset (new (std::nothrow) unsigned char [raddi::protocol::max_payload]);
+        if (!encoder.output)
+            return 0;
+    }
+
+    lzma_options_lzma options;
+    lzma_filter filters [2];
+
+    // output must be smaller than the batch, otherwise it's sent uncompressed
+
+    const auto output = encoder.output.get ();
+    const auto header = connection::batch_marker + sizeof (std::uint16_t);
+
+    std::size_t n = 0;
+    bool success = false;
+
+    if (batch_filters (filters, options, raddi::batch_compression_level)
+            && lzma_raw_encoder (&encoder.stream, filters) == LZMA_OK) {
+
+        encoder.stream.next_in = batch + connection::batch_marker;
+        encoder.stream.avail_in = size - connection::batch_marker;
+        encoder.stream.next_out = output + header;
+        encoder.stream.avail_out = size - 1 - header;
+
+        if (lzma_code (&encoder.stream, LZMA_FINISH) == LZMA_STREAM_END) {
+            n = header + (std::size_t) encoder.stream.total_out;
+            success = true;
+        }
+    }
+
+    this->compression.raw += size;
+    this->compression.compressed += success ? n : size;
+    this->compression.elapsed += raddi::microtimestamp () - t;
+
+    if (success) {
+        std::memcpy (output, connection::batch_mark, connection::batch_marker);
+        std::memset (output + connection::batch_marker, 0, sizeof (std::uint16_t));
+        *result = output;
+        return n;
+    } else
+        return 0;
+}
+
+bool raddi::connection::decompress (const unsigned char * data, std::size_t size) {
+    lzma_options_lzma options;
+    lzma_filter filters [2];
+
+    const auto batch = inflated.get ();
+    if (!batch)
+        throw std::bad_alloc ();
+
+    std::memcpy (batch, connection::batch_mark, connection::batch_marker);
+
+    std::size_t in = connection::batch_marker + sizeof (std::uint16_t);
+    std::size_t out = connection::batch_marker;
+
+    if (batch_filters (filters, options, 0)
+            && lzma_raw_buffer_decode (filters, nullptr, data, &in, size,
+                                       batch, &out, raddi::protocol::max_payload) == LZMA_OK
+            && (in == size)
+            && (out > connection::batch_marker + sizeof (std::uint16_t))
+            && (batch [connection::batch_marker + 0] || batch [connection::batch_marker + 1])) { // no nesting
+
+        this->compression.received += size;
+        this->compression.inflated += out;
+        return this->unpack (batch, out);
+    } else
+        return false;
+}
+
+bool raddi::connection::unpack (const unsigned char * batch, std::size_t size) {
+    std::size_t offset = connection::batch_marker;
+
+    if ((size >= offset + sizeof (std::uint16_t)) && !batch [offset + 0] && !batch [offset + 1])
+        return this->decompress (batch, size);
+
+    const auto entry = unpacked.get ();
+    if (!entry)
+        throw std::bad_alloc ();
+    while (offset != size) {
+        if (offset + sizeof (std::uint16_t) > size)
+            return false;
+
+        const std::size_t length = batch [offset + 0]
+                                | (batch [offset + 1] << 8);
+        offset += sizeof (std::uint16_t);
+
+        if (!length || (offset + length > size))
+            return false;
+
+        // copied to keep entries aligned
+
+        std::memcpy (entry, &batch [offset], length);
+
+        if (!this->deliver (entry, length))
+            return false;
+
+        offset += length;
+    }
+    return true;
+}
+
+bool raddi::connection::deliver (const unsigned char * data, std::size_t size) {
+    const auto t = raddi::microtimestamp ();
+    if (this->message (data, size)) {
+        this->messages += size;
+        this->latest = raddi::microtimestamp ();
+
+        this->credit.balance -= size;
+        this->credit.elapsed += this->latest - t;
+        this->credit.entries += 1;
+        return true;
     } else
         return false;
 }
 
-bool raddi::connection::send (enum class raddi::request::type type, const void * data, std::size_t size) {
+void raddi::connection::replenish () {
+    this->dispatch ();
+}
+
+bool raddi::connection::send (enum class raddi::request::type type, const void * data, std::size_t size, priority p) {
     if (size > raddi::request::max_payload)
         return false;
 
@@ -128,33 +537,44 @@ bool raddi::connection::send (enum class raddi::request::type type, const void *
     }
 
     this->report (log::level::note, 7, type, sizeof (request), size);
-    return this->send (&r, sizeof (request) + size);
+    return this->send (&r, sizeof (request) + size, p);
 }
 
-std::uint64_t raddi::connection::keepalive (std::uint64_t now, std::uint64_t expected, std::uint64_t period) {
-    if (!this->retired) {
-        if (std::int64_t (now - this->latest) > std::int64_t (std::max (4 * period, 1'000'000uLL))) {
-            this->cancel ();
-            this->report (raddi::log::level::event, 8);
-        }
-        if (this->secured) {
-            if (std::int64_t (now - std::max (this->latest, this->probed)) > std::int64_t (period)) {
-                if (!this->unsynchronized_is_live ()) {
-                    if (auto message = this->prepare (2)) {
-                        message [0] = 0x00;
-                        message [1] = 0x00;
-                        if (this->transmit (message, 2)) {
-                            this->probed = now;
-                        }
+std::size_t raddi::connection::backlogged () {
+    exclusive guard (this->Transmitter::lock);
+    return this->backlog + this->deferred + this->unsynchronized_buffer_size ();
+}
+
+std::uint64_t raddi::connection::keepalive (std::uint64_t now, std::uint64_t period) {
+    if (this->retired)
+        return 0;
+
+    const auto timeout = std::max (4 * period, 1'000'000uLL);
+    if (std::int64_t (now - this->latest) > std::int64_t (timeout)) {
+        this->cancel ();
+        this->report (raddi::log::level::event, 8);
+        return 0;
+    }
+
+    if (this->secured) {
+        if (std::int64_t (now - std::max (this->latest, this->probed)) > std::int64_t (period)) {
+            exclusive guard (this->Transmitter::lock);
+            if (!this->unsynchronized_is_live ()) {
+                if (auto message = this->prepare (2)) {
+                    message [0] = 0x00;
+                    message [1] = 0x00;
+                    if (this->transmit (message, 2)) {
+                        this->probed = now;
                     }
                 }
-            } else {
-                this->probed = std::max (this->latest, this->probed);
-                return std::min (expected, this->probed + period);
             }
+            return std::min (this->latest + timeout, now + period);
+        } else {
+            this->probed = std::max (this->latest, this->probed);
+            return std::min (this->latest + timeout, this->probed + period);
         }
-    }
-    return expected;
+    } else
+        return this->latest + timeout;
 }
 
 void raddi::connection::status () const {
@@ -164,6 +584,12 @@ void raddi::connection::status () const {
                   (raddi::microtimestamp () - std::max (this->probed, this->latest)) / 1'000'000uLL,
                   this->counter, this->messages, this->keepalives,
                   this->counters.sent, this->counters.delayed);// */
+
+    if (this->compression.raw || this->compression.received) {
+        this->report (raddi::log::level::note, 6,
+                      this->compression.raw, this->compression.compressed, this->compression.elapsed,
+                      this->compression.received, this->compression.inflated);
+    }
 }
 
 bool raddi::connection::inbound (const unsigned char * data, std::size_t & n) {
@@ -172,16 +598,18 @@ bool raddi::connection::inbound (const unsigned char * data, std::size_t & n) {
             std::uint32_t size = data [0] | (data [1] << 8);
             switch (size) {
 
-                case 0x0000:
+                case 0x0000: {
                     n = 2;
                     this->keepalives += n;
+
+                    exclusive guard (this->Transmitter::lock);
                     if (auto message = this->prepare (2)) {
                         message [0] = 0xFF;
                         message [1] = 0xFF;
                         return this->transmit (message, 2);
                     } else
                         return false;
-
+                }
                 case 0xFFFF:
                     n = 2;
                     this->latest = raddi::microtimestamp ();
@@ -190,13 +618,21 @@ bool raddi::connection::inbound (const unsigned char * data, std::size_t & n) {
                 default:
                     size += sizeof (std::uint16_t);
                     if (n >= size) {
-                        unsigned char entry [raddi::protocol::max_payload] alignas (raddi::entry);
-                        if (auto length = this->encryption->decode (entry, sizeof entry, data, size)) {
+                        const auto entry = decoded.get ();
+                        if (!entry) {
+                            this->out_of_memory ();
+                            return false;
+                        }
+                        if (auto length = this->encryption->decode (entry, raddi::protocol::max_payload, data, size)) {
+                            this->resuming = false;
                             try {
-                                if (this->message (entry, length)) {
-                                    this->messages += length;
-                                    this->latest = raddi::microtimestamp ();
+                                bool delivered;
+                                if ((length >= connection::batch_marker) && !std::memcmp (entry, connection::batch_mark, connection::batch_marker)) {
+                                    delivered = this->unpack (entry, length);
                                 } else {
+                                    delivered = this->deliver (entry, length);
+                                }
+                                if (!delivered) {
                                     this->discord ();
                                     return false;
                                 }
@@ -261,6 +697,7 @@ bool raddi::connection::inbound (const unsigned char * data, std::size_t & n) {
         if (n >= sizeof (raddi::protocol::keyset) + prologue) {
             if (this->head (reinterpret_cast <const raddi::protocol::keyset *> (data + prologue))) {
                 this->secured = true;
+                this->tally ();
                 n = sizeof (raddi::protocol::keyset) + prologue;
             } else {
                 this->discord ();
@@ -2,6 +2,7 @@
 #define RADDI_CONNECTION_H
 
 #include "raddi_request.h"
+#include "raddi_request_limiter.h"
 #include "raddi_protocol.h"
 #include "raddi_timestamp.h"
 #include "raddi_coordinator.h"
@@ -9,6 +10,10 @@
 
 #include "../node/server.h"
 #include "../common/log.h"
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <future>
 
 namespace raddi {
 
@@ -18,6 +23,13 @@ namespace raddi {
     //
     extern address socks5proxy;
 
+    // batch_compression/batch_compression_level
+    //  - whether batch frames are compressed for peers that announced support
+    //  - LZMA preset (0 to 9) to compress them with
+    //
+    extern bool batch_compression;
+    extern unsigned int batch_compression_level;
+
     // connection
     //  - represents RADDI.net peer connection state
     //
@@ -29,9 +41,13 @@ namespace raddi {
         virtual bool connected () override;
         virtual void overloaded () override;
         virtual void disconnected () override;
+        virtual std::uint64_t throttle () override;
+        virtual bool suspended (std::uint64_t delay) override;
 
         void discord ();
         void out_of_memory ();
+        void tally ();
+        bool resumable (raddi::protocol::ticket *, std::uint8_t * secret);
         bool head (const raddi::protocol::keyset * peer);
         bool message (const unsigned char * entry, std::size_t size);
 
@@ -40,13 +56,73 @@ namespace raddi {
             protocol::encryption * encryption; // this->secured == true
         };
 
+    public:
+
+        // priority
+        //  - transmission classes, see 'send' below
+        //
+        enum class priority : unsigned char {
+            control = 0,    // coordination requests
+            announcement,   // new identities and channels
+            propagation,    // fresh entries being propagated through the network
+            bulk,           // history and download responses
+        };
+        static constexpr std::size_t priorities = 4;
+
+    private:
+
+        // queues
+        //  - frames (not yet encrypted) waiting for transmission, one queue per priority class
+        //  - every frame is prefixed with 16-bit little endian length
+        //  - frames are moved (encrypted) into Transmitter's buffers only when those
+        //    are short (see 'dispatch'), so that higher priority frames overtake bulk
+        //
+        struct queue {
+            std::vector <unsigned char> data;
+            std::size_t head = 0;
+        } queues [priorities];
+        std::size_t backlog = 0; // payload bytes in all 'queues'
+
+        // delayed
+        //  - frames held back by coordinator's randomized broadcast delay, same format as 'queues'
+        //  - moved into 'queues' all at once by 'release'
+        //
+        queue delayed [priorities];
+        std::size_t deferred = 0; // payload bytes in all 'delayed'
+
+        // watermark
+        //  - amount of encrypted data kept in Transmitter's buffers
+        //
+        static constexpr std::size_t watermark = 2 * Transmitter::chunk_size;
+
+        // batch_marker/batch_mark
+        //  - batch frame payload starts with request header of reserved type 'batch' and zero mark
+        //    (no entry or valid request starts so), followed by frames in the same format as in 'queues'
+        //  - packed by 'dispatch' from frames waiting in one queue, only for peers that
+        //    announced (request::type::batching) they understand them
+        //
+        static constexpr std::size_t batch_marker = sizeof (std::uint32_t);
+        static constexpr unsigned char batch_mark [batch_marker] = { 0x00, 0x00, 0x00, (unsigned char) request::type::batch };
+
+        bool encode (const void * data, std::size_t size, bool immediate = true);
+        std::size_t pack (queue & q, unsigned char * batch);
+        bool unpack (const unsigned char * batch, std::size_t size);
+        std::size_t compress (const unsigned char * batch, std::size_t size, const unsigned char ** output);
+        bool decompress (const unsigned char * data, std::size_t size);
+        bool deliver (const unsigned char * data, std::size_t size);
+        bool overflows (std::size_t size, priority);
+        void congested ();
+        void dispatch ();
+        void replenish () override;
+
+        static void append (queue & q, const void * data, std::size_t size);
+
     public:
         explicit connection (Socket &&, const sockaddr * peer, raddi::level level);
         explicit connection (const address & peer, raddi::level level);
         ~connection ();
 
-        std::map <std::uint32_t, std::uint32_t> request_limiter; // TODO: separate class
-        std::uint32_t                           request_limiter_report_time = 0;
+        raddi::request_limiter                  request_limiter;
         std::uint32_t                           unsolicited = 0;
         // std::map <raddi::eid, std::uint32_t>    history_extension;
         std::uint32_t                           rejected = 0;
@@ -56,6 +132,92 @@ namespace raddi {
 
         bool            secured = false;
         bool            retired = false;
+        bool            batching = false; // peer understands batch frames
+        bool            partitioning = false; // peer serves core sync 'partition' requests
+        bool            corroborated = false; // peer's 'initial' request was received and verified
+
+        // tallied
+        //  - state and level the connection is currently counted as in coordinator's directory
+        //
+        struct {
+            unsigned char state = 0;
+            raddi::level  level = raddi::level::announced_nodes;
+        } tallied;
+
+        // scheduled
+        //  - number of entries in coordinator's 'postponed' and 'deadlines' wheels referencing
+        //    this connection; entries of retired connections are left to expire and skipped,
+        //    and the connection isn't swept until there are none, see coordinator::sweep
+        //
+        std::atomic <std::uint32_t> scheduled { 0 };
+
+        // credit
+        //  - receive budget, see coordinator::throttle
+        //  - 'balance' is number of bytes of entries the connection can still pass
+        //    to validation and database before receiving is suspended
+        //  - 'elapsed' microseconds spent processing 'entries' since last 'throttle'
+        //  - 'latency' moving average of microseconds spent validating and inserting single entry,
+        //    kept per connection so that workers don't contend on a shared cache line
+        //
+        struct {
+            std::int64_t  balance = 0;
+            std::uint64_t replenished = 0; // microtimestamp
+            std::uint64_t elapsed = 0;
+            std::uint64_t latency = 0;
+            std::uint32_t entries = 0;
+        } credit;
+
+        // compression
+        //  - compressed batch frame is marker, zero 16-bit length, and raw LZMA2 stream of the frames
+        //  - 'enabled' when peer announced it decompresses them, statistics for 'status'
+        //
+        struct {
+            bool          enabled = false;
+            std::uint64_t raw = 0; // bytes of batches compressed
+            std::uint64_t compressed = 0; // bytes they were compressed to (or raw size if not smaller)
+            std::uint64_t elapsed = 0; // microseconds spent compressing
+            std::uint64_t received = 0; // bytes of compressed batches received
+            std::uint64_t inflated = 0; // bytes they decompressed to
+        } compression;
+
+        // catchup
+        //  - 'supported' when peer announced it serves batched 'subscriptions'
+        //  - 'channels' of peer's 'subscriptions' requests accumulated until the final one
+        //
+        struct {
+            bool                                           supported = false;
+            std::vector <struct request::subscriptions::channel>  channels;
+        } catchup;
+
+        // cursor/cursors
+        //  - downloads being streamed to the peer in chunks, oldest first, see coordinator::stream
+        //  - 'position' is the last entry transmitted, null if none yet
+        //
+        struct cursor {
+            eid           parent; // null for all entries (full database download)
+            eid           position;
+            std::uint32_t threshold;
+            std::uint32_t latest;
+
+            std::shared_ptr <const std::vector <eid>> ids; // matching entries, if served from coordinator's download cache
+            std::shared_future <std::shared_ptr <const std::vector <eid>>> pending; // identical scan in progress, 'ids' when done
+        };
+        struct {
+            ::lock               lock;
+            std::deque <cursor>  queue;
+        } cursors;
+
+        // resumption
+        //  - secret derived from session keys, for ticket issued to (inbound connection)
+        //    or by (outbound connection) the peer, see protocol::resumption
+        //
+        std::uint8_t resumption [raddi::protocol::resumption::secret_size];
+
+        // resuming
+        //  - set when outbound connection presented resumption ticket, until first frame decodes
+        //  - peer that forgot the ticket (e.g. restarted) fails to agree on keys, see coordinator::disagreed
+        //
+        bool resuming = false;
 
         subscriptions   subscriptions;
 
@@ -63,6 +225,7 @@ namespace raddi {
         using Connection::pending;
         using Connection::optimize;
         using Connection::buffer_size;
+        using Connection::resume;
 
     public:
         std::uint64_t latest = raddi::microtimestamp ();
@@ -102,28 +265,48 @@ namespace raddi {
 
         // send
         //  - using Connection Transmitter facilities encodes provided data
-        //    directly into either transmission buffer and initiates transmission
-        //    or into buffer of pending data
+        //    directly into transmission buffer and initiates transmission,
+        //    or, if there's already enough data waiting, queues them by 'priority'
+        //  - queued frames are transmitted by weighted round-robin so that
+        //    lower priority classes get some bandwidth too
+        //
+        bool send (const void * data, std::size_t size, priority = priority::propagation);
+
+        // delay
+        //  - holds the frame back until coordinator's broadcast scheduler calls 'release'
+        //  - returns 1 if this is the first frame held back and the caller must schedule 'release',
+        //    0 if the frame joined already scheduled batch, or -1 on failure
+        //
+        int delay (const void * data, std::size_t size, priority);
+
+        // release
+        //  - moves all delayed frames to transmission queues and transmits them together
         //
-        bool send (const void * data, std::size_t size);
+        void release ();
 
         // send
         //  - assembles full raddi::request packet and sends it just like 'send' above
+        //    with 'control' priority, unless it needs to stay in order with other frames
         //
-        bool send (enum class raddi::request::type, const void * payload, std::size_t size);
+        bool send (enum class raddi::request::type, const void * payload, std::size_t size, priority = priority::control);
         bool send (enum class raddi::request::type t) {
             return this->send (t, nullptr, 0);
         }
 
+        // backlogged
+        //  - returns number of bytes waiting for transmission, queued, delayed and encrypted
+        //
+        std::size_t backlogged ();
+
         // keepalive
-        //  - transmits keep-alive token if there's no other transmission pending or queued
-        //    and updates expected time of a next keep-alive
+        //  - cancels the connection if nothing was received for too long, otherwise transmits
+        //    keep-alive token if there's no other transmission pending or queued
         //  - parameters: micronow - raddi::microtimestamp retrieved earlier
-        //                expected - current microsecond delay until next keep-alive
         //                period - microsecond keep-alive period
-        //  - returns new expected microsecond delay until next keepalive needs to be transmitted
+        //  - returns microtimestamp when the connection needs to be checked again,
+        //    or 0 if it's retired/cancelled and doesn't need to
         //
-        std::uint64_t keepalive (std::uint64_t micronow, std::uint64_t expected, std::uint64_t period);
+        std::uint64_t keepalive (std::uint64_t micronow, std::uint64_t period);
 
         // cancel
         //  - closes the socket interrupting pending transmissions and receives
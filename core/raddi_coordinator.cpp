@@ -6,6 +6,7 @@
 #include "raddi_database_shard.h"
 
 #include "../common/directory.h"
+#include <algorithm>
 
 raddi::coordinator::coordinator (db & database)
     : provider ("coordinator")
@@ -62,13 +63,100 @@ std::uint64_t raddi::coordinator::keepalive () {
     auto next = now + period;
 
     immutability guard (this->lock);
-    for (auto & connection : connections) {
-        next = connection.keepalive (now, next, period);
-    }
+    exclusive guard2 (this->deadlines.lock);
+
+    this->deadlines.wheel.advance (now, [this, now, period] (connection * connection) {
+        connection->scheduled--;
+        if (auto deadline = connection->keepalive (now, period)) {
+            try {
+                this->deadlines.wheel.schedule (now, deadline - std::min (deadline, now), connection);
+                connection->scheduled++;
+            } catch (const std::bad_alloc &) {
+                connection->cancel ();
+            }
+        }
+    });
 
+    if (auto deadline = this->deadlines.wheel.next ()) {
+        if (deadline < next) {
+            next = std::max (deadline, now + 1);
+        }
+    }
     return next - now;
 }
 
+void raddi::coordinator::track (connection * connection) {
+    try {
+        address ip = connection->peer;
+        ip.port = 0;
+
+        this->directory.index.insert ({ ip, connection });
+        this->tally (connection);
+
+        exclusive guard (this->deadlines.lock);
+        this->deadlines.wheel.schedule (raddi::microtimestamp (), 1000uLL * this->settings.keep_alive_period, connection);
+        connection->scheduled++;
+
+    } catch (const std::bad_alloc &) {
+        connection->cancel ();
+    }
+}
+
+void raddi::coordinator::untrack (connection * connection) {
+
+    // partition being downloaded from the connection is left for other core node to continue
+
+    this->synchronization.lock.acquire_exclusive ();
+    for (auto & partition : this->synchronization.partitions) {
+        if (partition.source == connection) {
+            partition.source = nullptr;
+        }
+    }
+    this->synchronization.stalled.erase (std::remove (this->synchronization.stalled.begin (),
+                                                      this->synchronization.stalled.end (), connection),
+                                         this->synchronization.stalled.end ());
+    if (this->synchronization.snapshot == connection) {
+        this->synchronization.snapshot = nullptr; // rest of the range is partitioned by time
+    }
+    this->synchronization.lock.release_exclusive ();
+
+    address ip = connection->peer;
+    ip.port = 0;
+
+    auto range = this->directory.index.equal_range (ip);
+    for (auto i = range.first; i != range.second; ++i) {
+        if (i->second == connection) {
+            this->directory.index.erase (i);
+            break;
+        }
+    }
+    this->tally (connection, true);
+}
+
+void raddi::coordinator::tally (connection * connection, bool retiring) {
+    unsigned char state = 0;
+    if (!retiring && !connection->retired) {
+        if (connection->secured) {
+            state = 2;
+        } else
+        if (connection->connecting) {
+            state = 1;
+        }
+    }
+
+    exclusive guard (this->directory.lock);
+    switch (connection->tallied.state) {
+        case 1: --this->directory.attempting [connection->tallied.level]; break;
+        case 2: --this->directory.connected [connection->tallied.level]; break;
+    }
+    switch (state) {
+        case 1: ++this->directory.attempting [connection->level]; break;
+        case 2: ++this->directory.connected [connection->level]; break;
+    }
+    connection->tallied.state = state;
+    connection->tallied.level = connection->level;
+}
+
 void raddi::coordinator::sweep () {
     exclusive guard (this->lock);
 
@@ -77,7 +165,8 @@ void raddi::coordinator::sweep () {
     
     if (ii != ie) {
         do {
-            if (ii->retired && !ii->pending ()) {
+            if (ii->retired && !ii->pending () && !ii->scheduled) {
+                this->untrack (&*ii);
                 ii = this->connections.erase (ii);
                 ie = this->connections.end ();
             } else {
@@ -109,9 +198,7 @@ void raddi::coordinator::optimize () {
         if (connection.secured && !connection.retired) {
             connection.optimize ();
         }
-        // TODO: close congested connections // connection.buffer_size () > threshold?
-        //       don't terminate all, settings.connections? only those that did not recently asked for subscription/download?
-
+        // NOTE: congested connections (Transmitter::limit) are closed in 'connection::send'
     }
 }
 
@@ -175,6 +262,13 @@ void raddi::coordinator::terminate () {
 
     this->listeners.clear ();
     this->discoverers.clear ();
+    this->postponed.lock.acquire_exclusive ();
+    this->postponed.wheel.erase_if ([] (connection *) { return true; });
+    this->postponed.lock.release_exclusive ();
+    this->deadlines.lock.acquire_exclusive ();
+    this->deadlines.wheel.erase_if ([] (connection *) { return true; });
+    this->deadlines.lock.release_exclusive ();
+    this->directory.index.clear ();
     this->connections.clear ();
     this->lock.release_shared ();
 }
@@ -266,16 +360,19 @@ void raddi::coordinator::operator() () {
             // clean connect requests set
             //  - don't connect to addresses already connected to
 
-            for (const auto & connection : connections) {
-                if (!connection.retired) {
-                    this->connect_requests.erase (connection.peer);
+            auto i = this->connect_requests.begin ();
+            while (i != this->connect_requests.end ()) {
+                if (this->inuse (i->first, false)) {
+                    i = this->connect_requests.erase (i);
+                } else {
+                    ++i;
                 }
             }
 
             // insert
 
             while ((n > 0) && !this->connect_requests.empty ()) {
-                addresses.insert ({ *this->connect_requests.begin (), announced_nodes });
+                addresses.insert (*this->connect_requests.begin ());
                 this->connect_requests.erase (this->connect_requests.begin ());
                 --n;
             }
@@ -309,7 +406,9 @@ void raddi::coordinator::operator() () {
 
             for (const auto & [address, level] : addresses) {
                 try {
-                    this->connections.emplace_front (address, level).connect ();
+                    auto & connection = this->connections.emplace_front (address, level);
+                    this->track (&connection);
+                    connection.connect ();
                 } catch (const raddi::log::exception &) {
                     this->ban (address, 64); // TODO: constants.h or settings?, bad address ban days (64)
                 }
@@ -323,6 +422,8 @@ void raddi::coordinator::operator() () {
         }
     }
 
+    this->supervise_synchronization (now);
+
     this->recent.clean (raddi::consensus::max_entry_age_allowed);
     this->detached.clean (raddi::consensus::max_entry_age_allowed + raddi::consensus::max_entry_skew_allowed + 1);
 
@@ -355,34 +456,18 @@ bool raddi::coordinator::process (const unsigned char * data, std::size_t size,
         // TODO: evaluate need for locking 'connection' against getting destroyed from under our hands,
         //       add lock to prevent setting connection->retired = true while any callback is executing
 
+        const auto r = reinterpret_cast <const request *> (data);
+
         if (this->settings.max_requests_per_minute) {
             const auto now = raddi::now ();
 
-            // increment entry for current timestamp
-            //  - if it was zero, it means time moved by more than a second
-            //    and there might be entries older than 1 minute to cleanup
-
-            if (++connection->request_limiter [now] == 1u) {
-
-                auto ii = connection->request_limiter.begin ();
-                auto ie = connection->request_limiter.end ();
-
-                while ((ii != ie) && (raddi::older (ii->first, now - 60u))) {
-                    ii = connection->request_limiter.erase (ii);
-                }
-            }
-            
-            auto requests = 0u;
-            for (const auto & record : connection->request_limiter) {
-                requests += record.second;
-            }
-
-            // simply ignore more than moderate amount of requests per second 
+            // simply ignore more than moderate amount of requests per minute
+            //  - requests are weighted by their cost, see 'request_limiter::cost'
             //  - report it, but only max once per second
 
-            if (requests >= this->settings.max_requests_per_minute) {
-                if (connection->request_limiter_report_time != now) {
-                    connection->request_limiter_report_time = now;
+            if (connection->request_limiter.charge (now, request_limiter::cost (r->type)) >= this->settings.max_requests_per_minute) {
+                if (connection->request_limiter.report_time != now) {
+                    connection->request_limiter.report_time = now;
 
                     this->report (log::level::data, 0x20, connection->peer, this->settings.max_requests_per_minute);
                 }
@@ -390,8 +475,6 @@ bool raddi::coordinator::process (const unsigned char * data, std::size_t size,
             }
         }
 
-        const auto r = reinterpret_cast <const request *> (data);
-
         switch (r->type) {
             case request::type::ipv4peer:
             case request::type::ipv6peer:
@@ -407,6 +490,7 @@ bool raddi::coordinator::process (const unsigned char * data, std::size_t size,
 
             case request::type::initial:
                 if (std::memcmp (r->content (), raddi::protocol::magic, sizeof raddi::protocol::magic) == 0) {
+                    connection->corroborated = true;
                     this->corroborated (connection);
                     return true;
                 } else
@@ -441,7 +525,7 @@ bool raddi::coordinator::process (const unsigned char * data, std::size_t size,
 
             case request::type::peers:
                 this->announce_random_peers (connection);
-                connection->request_limiter [raddi::now ()] += this->settings.max_requests_per_minute / 3;
+                connection->request_limiter.charge (raddi::now (), this->settings.max_requests_per_minute / 3);
                 break;
 
             // ipv4peer/ipv6peer
@@ -530,11 +614,24 @@ bool raddi::coordinator::process (const unsigned char * data, std::size_t size,
                 else
                     return true;
 
+            case request::type::identities_reconciliation:
+                if (this->settings.channels_synchronization_participation && this->settings.channels_reconciliation)
+                    return this->process_table_reconciliation <request::type::identities_reconciliation> (reinterpret_cast <const request::reconciliation *> (r->content ()),
+                                                                                                          size, connection, database.identities.get ());
+                else
+                    return true;
+            case request::type::channels_reconciliation:
+                if (this->settings.channels_synchronization_participation && this->settings.channels_reconciliation)
+                    return this->process_table_reconciliation <request::type::channels_reconciliation> (reinterpret_cast <const request::reconciliation *> (r->content ()),
+                                                                                                        size, connection, database.channels.get ());
+                else
+                    return true;
+
             case request::type::subscribe:
                 if (auto subscription = reinterpret_cast <const request::subscription *> (r->content ())) {
                     auto subscription_size = size - sizeof (request);
 
-                    if (subscription->history.is_valid_size (subscription_size)) {
+                    if (subscription->history.is_valid_size (subscription_size - sizeof (eid))) {
 
                         // TODO: connection->history_extension = ;
 
@@ -549,7 +646,156 @@ bool raddi::coordinator::process (const unsigned char * data, std::size_t size,
                 break;
 
             case request::type::download:
-                this->process_download_request (reinterpret_cast <const request::download *> (r->content ()), connection);
+                if (this->process_download_request (reinterpret_cast <const request::download *> (r->content ()), connection)) {
+                    this->stream (connection);
+                }
+                break;
+
+            // resume
+            //  - peer reconnected and wants to continue download past the last entry it received
+
+            case request::type::resume:
+                if (auto resume = reinterpret_cast <const request::continuation *> (r->content ())) {
+                    request::download download;
+                    download.parent = resume->parent;
+                    download.threshold = resume->position.timestamp;
+
+                    if (this->process_download_request (&download, connection, &resume->position)) {
+                        this->stream (connection);
+                    }
+                }
+                break;
+
+            // partition
+            //  - other core node downloads part of full database from us, report how much we have
+            //  - only core nodes, and only those are exempt from download limit when snapshots are allowed
+
+            case request::type::partition:
+                if (!this->is_core (connection)) {
+                    this->report (log::level::data, 0x2B, connection->peer, r->type);
+                } else
+                if (auto partition = reinterpret_cast <const request::partition *> (r->content ())) {
+                    request::download download;
+                    std::memset (&download.parent, 0, sizeof download.parent);
+                    download.threshold = partition->oldest;
+
+                    if (this->process_download_request (&download, connection, &partition->position, partition->latest,
+                                                        this->settings.snapshots_allowed)) {
+
+                        // tally only what will be transmitted, see 'full_database_download_limit'
+
+                        auto oldest = partition->oldest;
+                        auto now = raddi::now ();
+                        if (!this->settings.snapshots_allowed && (now - oldest > this->settings.full_database_download_limit)) {
+                            oldest = now - this->settings.full_database_download_limit;
+                        }
+
+                        request::tally tally;
+                        tally.oldest = partition->oldest;
+                        tally.latest = partition->latest;
+                        tally.count = (std::uint32_t) this->database.data->count (oldest, partition->latest);
+
+                        connection->send (request::type::tally, &tally, sizeof tally);
+                        this->stream (connection);
+                    }
+                }
+                break;
+
+            // tally/continuation
+            //  - core node we download partition from reports its size and progress
+
+            case request::type::tally:
+                if (auto tally = reinterpret_cast <const request::tally *> (r->content ())) {
+                    exclusive guard (this->synchronization.lock);
+                    for (auto & partition : this->synchronization.partitions) {
+                        if (partition.source == connection && partition.oldest == tally->oldest && partition.latest == tally->latest) {
+                            partition.expected = tally->count;
+                            partition.deadline = raddi::now () + this->settings.partition_timeout;
+                        }
+                    }
+                }
+                break;
+
+            // snapshot/manifest
+            //  - other core node compares its shards to ours, and we receive such comparison, see 'synchronize'
+
+            //  - denied snapshot is replied with empty final manifest, for the core node not to wait for it
+
+            case request::type::snapshot:
+                if (this->is_core (connection) && this->settings.snapshots_allowed) {
+                    this->process_snapshot_request (*reinterpret_cast <const std::uint32_t *> (r->content ()), connection);
+                } else {
+                    if (!this->is_core (connection)) {
+                        this->report (log::level::data, 0x2B, connection->peer, r->type);
+                    } else {
+                        this->report (log::level::data, 0x29, connection->peer);
+                    }
+
+                    request::manifest packet;
+                    packet.flags = 0x01;
+                    connection->send (request::type::manifest, &packet, request::manifest::size (0));
+                }
+                break;
+
+            case request::type::manifest:
+                this->process_manifest (reinterpret_cast <const request::manifest *> (r->content ()), size - sizeof (request), connection);
+                break;
+
+            case request::type::continuation:
+                if ((connection->level == core_nodes) && reinterpret_cast <const request::continuation *> (r->content ())->parent.isnull ()) {
+                    this->synchronized (connection, reinterpret_cast <const request::continuation *> (r->content ()));
+                }
+                break;
+
+            // elaborate
+            //  - peer has more entries in our history span, break it down for the peer
+            //  - only for channels we are subscribed to, and asked the peer about
+
+            case request::type::elaborate:
+                if (auto elaboration = reinterpret_cast <const request::elaboration *> (r->content ())) {
+                    if (this->subscriptions.is_subscribed ({ elaboration->channel })) {
+
+                        request::breakdown packet;
+                        auto length = this->gather_breakdown (elaboration->channel, elaboration->oldest, elaboration->latest, &packet);
+                        connection->send (request::type::breakdown, &packet, length);
+                    }
+                }
+                break;
+
+            case request::type::breakdown:
+                if (auto breakdown = reinterpret_cast <const request::breakdown *> (r->content ())) {
+                    if (connection->subscriptions.is_subscribed ({ breakdown->channel })) {
+                        this->process_breakdown (breakdown, size - sizeof (request), connection);
+                    }
+                }
+                break;
+
+            // catchup/subscriptions
+            //  - channels of batched subscriptions are accumulated until the final request,
+            //    then served together, see 'process_subscriptions'
+
+            case request::type::catchup:
+                connection->catchup.supported = true;
+                break;
+
+            case request::type::partitioning:
+                connection->partitioning = true;
+                break;
+
+            case request::type::subscriptions:
+                if (auto subscriptions = reinterpret_cast <const request::subscriptions *> (r->content ())) {
+                    const auto n = subscriptions->length (size - sizeof (request));
+
+                    for (auto i = 0u; i != n; ++i) {
+                        if (connection->catchup.channels.size () < this->settings.max_individual_subscriptions) {
+                            connection->subscriptions.subscribe (subscriptions->channel [i].channel, this->settings.max_individual_subscriptions);
+                            connection->catchup.channels.push_back (subscriptions->channel [i]);
+                        }
+                    }
+                    if (subscriptions->flags & 0x01) {
+                        this->process_subscriptions (connection);
+                    }
+                }
                 break;
 
             case request::type::everything:
@@ -559,6 +805,46 @@ bool raddi::coordinator::process (const unsigned char * data, std::size_t size,
             case request::type::unsubscribe:
                 connection->subscriptions.unsubscribe (*reinterpret_cast <const eid *> (r->content ()));
                 break;
+
+            // batching
+            //  - peer can demultiplex batch frames, queued entries can now be packed into them
+
+            case request::type::batching:
+                connection->batching = true;
+                break;
+
+            case request::type::compression:
+                connection->compression.enabled = true;
+                break;
+
+            // ticket
+            //  - peer we connected to issued resumption ticket for our next connection
+            //  - inbound connections have no use for tickets, their peer's port is unknown
+
+            case request::type::ticket:
+                if (connection->is_outbound () && protocol::resumption::lifetime) {
+                    exclusive guard (this->tickets.lock);
+
+                    // drop expired tickets when full
+
+                    if (this->tickets.map.size () >= 4096) {
+                        const auto now = raddi::now ();
+                        for (auto i = this->tickets.map.begin (); i != this->tickets.map.end (); ) {
+                            if (raddi::older (i->second.received, now - protocol::resumption::lifetime)) {
+                                i = this->tickets.map.erase (i);
+                            } else {
+                                ++i;
+                            }
+                        }
+                    }
+                    if (this->tickets.map.size () < 4096) {
+                        auto & t = this->tickets.map [connection->peer];
+                        std::memcpy (&t.ticket, r->content (), sizeof t.ticket);
+                        std::memcpy (t.secret, connection->resumption, sizeof t.secret);
+                        t.received = raddi::now ();
+                    }
+                }
+                break;
         }
         return true;
     } else
@@ -568,9 +854,13 @@ bool raddi::coordinator::process (const unsigned char * data, std::size_t size,
 template <enum class raddi::request::type RT, typename Key>
 bool raddi::coordinator::process_table_history (const raddi::request::history * history, std::size_t size,
                                                 raddi::connection * connection, db::table <Key> * table) {
+    constexpr auto RR = (RT == request::type::identities) ? request::type::identities_reconciliation
+                                                          : request::type::channels_reconciliation;
+
     auto map = history->decode (size - sizeof (request));
     auto transmitter = [connection] (const auto & row, const auto & detail, std::uint8_t * data) {
-        connection->send (data, (std::size_t) row.data.length + sizeof (raddi::entry));
+        if (!connection->send (data, (std::size_t) row.data.length + sizeof (raddi::entry), raddi::connection::priority::bulk))
+            throw false; // transmission queue is full, see 'connection::overflows'
     };
 
     std::uint32_t origin = 0;
@@ -593,36 +883,204 @@ bool raddi::coordinator::process_table_history (const raddi::request::history *
     this->report (log::level::event, 0x27, connection->peer, RT,
                   oldest, latest, map.size (), size - sizeof (request), total, history->threshold);
 
-    // if there is any history
-    if (!map.empty ()) {
+    // reconciliation is limited to synchronization window, spans reaching beyond are sent whole
+    const auto window = raddi::now () - this->database.settings.synchronization_threshold;
 
-        // start with total ancient history
-        std::size_t n = table->count (origin, oldest - 1);
-        if (n) {
-            database.identities->select (origin, oldest - 1, transmitter);
-            this->report (log::level::note, 0x27, connection->peer, RT, origin, oldest - 1, 0, n);
+    try {
+        // if there is any history
+        if (!map.empty ()) {
+
+            // start with total ancient history
+            std::size_t n = table->count (origin, oldest - 1);
+            if (n) {
+                database.identities->select (origin, oldest - 1, transmitter);
+                this->report (log::level::note, 0x27, connection->peer, RT, origin, oldest - 1, 0, n);
+            }
+
+            // compare peer's ranges against amount of data we have
+            for (const auto & m : map) {
+                n = table->count (m.first.first, m.first.second);
+
+                this->report (log::level::note, 0x27, connection->peer, RT, m.first.first, m.first.second, m.second, n);
+
+                // if we have more entries than peer does
+                //  - reconcile the span if the peer supports it and has more than just a few entries in it
+
+                if (n > m.second) {
+                    if ((history->flags & 0x0002) && this->settings.channels_reconciliation && (m.second > request::reconciliation::leaf)
+                            && !raddi::older (m.first.first, window)) {
+                        this->reconcile <RR> (connection, table, m.first.first, m.first.second, 0);
+                    } else {
+                        table->select (m.first.first, m.first.second, transmitter);
+                    }
+                }
+            }
         }
 
-        // compare peer's ranges against amount of data we have
-        for (const auto & m : map) {
-            n = table->count (m.first.first, m.first.second);
+        // and finish with the most recent data
+        table->select (history->threshold ? history->threshold : origin, raddi::now (), transmitter);
+
+    } catch (bool) {
+        // rest of the reply doesn't fit, peer can ask again
+    }
+    return true;
+}
+
+template <enum class raddi::request::type RT, typename Key>
+bool raddi::coordinator::process_table_reconciliation (const raddi::request::reconciliation * range, std::size_t size,
+                                                       raddi::connection * connection, db::table <Key> * table) {
+    auto transmitter = [connection] (const auto & row, const auto & detail, std::uint8_t * data) {
+        if (!connection->send (data, (std::size_t) row.data.length + sizeof (raddi::entry), raddi::connection::priority::bulk))
+            throw false; // transmission queue is full, see 'connection::overflows'
+    };
+
+    if (range->round >= request::reconciliation::max_rounds)
+        return true;
+
+    // range beyond synchronization window would let peer make us digest whole table repeatedly
+    if (raddi::older (range->oldest, raddi::now () - this->database.settings.synchronization_threshold))
+        return true;
+
+    const auto n = range->length (size - sizeof (request));
 
-            this->report (log::level::note, 0x27, connection->peer, RT, m.first.first, m.first.second, m.second, n);
+    std::uint64_t digests [request::reconciliation::max_parts];
+    std::size_t numbers [request::reconciliation::max_parts];
+    this->digest_table_range (range, n, table, digests, numbers);
 
-            // if we have more entries than peer does
-            if (n > m.second) {
-                table->select (m.first.first, m.first.second, transmitter);
+    std::size_t differ = 0;
+    std::size_t sent = 0;
+
+    for (auto i = 0u; i != n; ++i) {
+        const std::size_t ours = numbers [i];
+        const std::size_t theirs = (range->part [i].number [0] << 0)
+                                 | (range->part [i].number [1] << 8);
+
+        std::uint64_t digest = 0;
+        for (auto b = 0u; b != sizeof range->part [i].digest; ++b) {
+            digest |= std::uint64_t (range->part [i].digest [b]) << (8 * b);
+        }
+
+        if ((std::min (ours, std::size_t (0xFFFF)) != theirs) || ((digests [i] & 0xFFFF'FFFF'FFFFuLL) != digest)) {
+            const auto bounds = range->bounds (i, n);
+            ++differ;
+
+            // either side has only few entries, or the part can't be divided further
+            //  - send everything we have and, unless the peer already did, ask for the same
+
+            if ((ours <= request::reconciliation::leaf) || (theirs <= request::reconciliation::leaf) || (bounds.first == bounds.second)) {
+                if (ours) {
+                    try {
+                        sent += table->select (bounds.first, bounds.second, transmitter);
+                    } catch (bool) {
+                        break;
+                    }
+                }
+                if (theirs && !(range->flags & 0x01)) {
+                    this->reconcile <RT> (connection, table, bounds.first, bounds.second, range->round + 1, 0x01, 1);
+                }
+            } else {
+                this->reconcile <RT> (connection, table, bounds.first, bounds.second, range->round + 1);
             }
         }
     }
 
-    // and finish with the most recent data
-    table->select (history->threshold ? history->threshold : origin, raddi::now (), transmitter);
+    this->report (log::level::note, 0x2C, connection->peer, RT, range->round, range->oldest, range->latest, n, differ, sent);
     return true;
 }
 
+template <enum class raddi::request::type RT, typename Key>
+bool raddi::coordinator::reconcile (connection * connection, db::table <Key> * table, std::uint32_t oldest, std::uint32_t latest,
+                                    std::uint8_t round, std::uint8_t flags, std::size_t n) const {
+    request::reconciliation packet;
+    packet.oldest = oldest;
+    packet.latest = latest;
+    packet.round = round;
+    packet.flags = flags;
+
+    if (n > packet.width ()) {
+        n = (std::size_t) packet.width ();
+    }
+
+    std::uint64_t digests [request::reconciliation::max_parts];
+    std::size_t numbers [request::reconciliation::max_parts];
+    this->digest_table_range (&packet, n, table, digests, numbers);
+
+    for (auto i = 0u; i != n; ++i) {
+        const auto number = std::min (numbers [i], std::size_t (0xFFFF));
+
+        packet.part [i].number [0] = (number >> 0) & 0xFF;
+        packet.part [i].number [1] = (number >> 8) & 0xFF;
+
+        for (auto b = 0u; b != sizeof packet.part [i].digest; ++b) {
+            packet.part [i].digest [b] = (digests [i] >> (8 * b)) & 0xFF;
+        }
+    }
+    return connection->send (RT, &packet, request::reconciliation::size (n));
+}
+
+template <typename Key>
+void raddi::coordinator::digest_table_range (const request::reconciliation * range, std::size_t n, db::table <Key> * table,
+                                             std::uint64_t * digests, std::size_t * numbers) const {
+    std::fill (digests, digests + n, 0);
+    std::fill (numbers, numbers + n, 0);
+
+    // digest
+    //  - XOR of short hashes of IDs of all entries within each part, order independent
+    //  - key is fixed (zero), digests need to be comparable across nodes
+
+    table->select (range->oldest, range->latest,
+                   [range, n, digests, numbers] (const Key & row, const auto & detail) {
+                       static const unsigned char key [crypto_shorthash_KEYBYTES] = {};
+
+                       std::uint64_t hash;
+                       crypto_shorthash (reinterpret_cast <unsigned char *> (&hash),
+                                         reinterpret_cast <const unsigned char *> (&row.id), sizeof row.id, key);
+
+                       const auto i = range->index (row.id.timestamp, n);
+                       digests [i] ^= hash;
+                       numbers [i] += 1;
+                       return true;
+                   },
+                   [] (const Key &, const auto & detail) { return false; },
+                   [] (const Key &, const auto & detail, std::uint8_t *) {});
+}
+
+template <typename Key>
+void raddi::coordinator::digest_table_ranges (const std::pair <std::uint32_t, std::uint32_t> * ranges, std::size_t n, db::table <Key> * table,
+                                              std::uint64_t * digests, std::size_t * numbers) const {
+    std::fill (digests, digests + n, 0);
+    std::fill (numbers, numbers + n, 0);
+
+    // digests
+    //  - same as 'digest_table_range' but for 'n' sorted, non-overlapping ranges (shards)
+    //  - single pass through the table, row's range is found by binary search
+
+    if (n) {
+        table->select (ranges [0].first, ranges [n - 1].second,
+                       [ranges, n, digests, numbers] (const Key & row, const auto & detail) {
+                           static const unsigned char key [crypto_shorthash_KEYBYTES] = {};
+
+                           const auto t = row.id.timestamp;
+                           const auto i = std::upper_bound (ranges, ranges + n, t,
+                                                            [] (std::uint32_t t, const auto & range) { return t < range.first; }) - ranges;
+
+                           if (i && (t <= ranges [i - 1].second)) {
+                               std::uint64_t hash;
+                               crypto_shorthash (reinterpret_cast <unsigned char *> (&hash),
+                                                 reinterpret_cast <const unsigned char *> (&row.id), sizeof row.id, key);
+
+                               digests [i - 1] ^= hash;
+                               numbers [i - 1] += 1;
+                           }
+                           return false;
+                       },
+                       [] (const Key &, const auto & detail) { return false; },
+                       [] (const Key &, const auto & detail, std::uint8_t *) {});
+    }
+}
+
 bool raddi::coordinator::process_history (const raddi::request::subscription * subscription, std::size_t size, connection * connection) {
-    auto map = subscription->history.decode (size);
+    auto map = subscription->history.decode (size - sizeof (eid));
     auto channel = subscription->channel;
     auto constrain = [channel] (const auto & row, const auto & detail) {
         return channel == row.top ().channel
@@ -632,7 +1090,8 @@ bool raddi::coordinator::process_history (const raddi::request::subscription * s
         return true;
     };
     auto transmitter = [connection] (const auto & row, const auto & detail, std::uint8_t * data) {
-        connection->send (data, (std::size_t) row.data.length + sizeof (raddi::entry));
+        if (!connection->send (data, (std::size_t) row.data.length + sizeof (raddi::entry), raddi::connection::priority::bulk))
+            throw false; // transmission queue is full, see 'connection::overflows'
     };
 
     std::uint32_t oldest = 0;
@@ -653,88 +1112,997 @@ bool raddi::coordinator::process_history (const raddi::request::subscription * s
     if (map.empty ()) {
         oldest = subscription->history.threshold;
     }
-    if (oldest) {
-        // first send all old thread-level entries (also meta, sideband updates, etc.)
-        auto n = this->database.threads->select (0, oldest, constrain, decission, transmitter);
-        this->report (log::level::note, 0x2B, connection->peer, channel, oldest, n);
-    }
-    
-    for (const auto & m : map) {
-        auto n = this->database.data->count (m.first.first, m.first.second);
-        this->report (log::level::note, 0x27, connection->peer, channel, m.first.first, m.first.second, m.second, n);
+    try {
+        if (oldest) {
+            // first send all old thread-level entries (also meta, sideband updates, etc.)
+            auto n = this->database.threads->select (0, oldest, constrain, decission, transmitter);
+            this->report (log::level::note, 0x2B, connection->peer, channel, oldest, n);
+        }
 
-        // if we have more entries than peer does
-        if (n > m.second) {
-            this->database.data->select (m.first.first, m.first.second, constrain, decission, transmitter);
+        if (this->process_history_spans (channel, map, subscription->history.flags & 0x0001, { 0, 0 }, connection)) {
+
+            // and finish with the most recent data
+            this->database.data->select (subscription->history.threshold, raddi::now (), constrain, decission, transmitter);
         }
+    } catch (bool) {
+        // rest of the reply doesn't fit, peer can subscribe again
     }
-
-    // and finish with the most recent data
-    this->database.data->select (subscription->history.threshold, raddi::now (), constrain, decission, transmitter);
     return true;
 }
 
-void raddi::coordinator::process_download_request (const request::download * download, connection * connection) {
-    auto now = raddi::now ();
-    auto parent = download->parent;
-    auto threshold = download->threshold;
+void raddi::coordinator::gather_subscriptions (connection * connection) {
+    const auto now = raddi::now ();
+    const auto threshold = now - this->database.settings.synchronization_threshold;
 
-    if (parent.isnull ()) {
-        if (!this->settings.full_database_downloads_allowed) {
-            this->report (log::level::data, 0x26, connection->peer);
-            return;
+    std::map <eid, std::uint32_t> channels;
+    this->subscriptions.enumerate ([connection, &channels] (auto eid) {
+        if ((eid.timestamp != eid.identity.timestamp) || (connection->level == core_nodes)) {
+            channels [eid] = 0;
         }
+    });
 
-        // check against limit for full download
+    if (channels.empty ())
+        return;
 
-        if (now - threshold > this->settings.full_database_download_limit) {
-            threshold = now - this->settings.full_database_download_limit;
+    // count entries of all subscribed channels in single pass
+    //  - each channel's history is then single span from 'threshold'
+
+    this->database.data->select (threshold, now,
+                                 [&channels] (const auto & row, const auto &) {
+                                     auto i = channels.find (row.top ().channel);
+                                     if (i == channels.end ()) {
+                                         i = channels.find (row.top ().thread);
+                                     }
+                                     if (i != channels.end ()) {
+                                         ++i->second;
+                                     }
+                                     return false;
+                                 },
+                                 [] (const auto &, const auto &) { return false; },
+                                 [] (const auto &, const auto &, std::uint8_t *) {});
+
+    request::subscriptions packet;
+    std::memset (&packet, 0, sizeof packet);
+
+    std::size_t n = 0;
+    std::size_t remaining = channels.size ();
+
+    for (const auto & channel : channels) {
+        packet.channel [n].channel = channel.first;
+        packet.channel [n].threshold = threshold;
+        packet.channel [n].number = channel.second;
+
+        --remaining;
+        if ((++n == request::subscriptions::max_channels) || !remaining) {
+            packet.flags = remaining ? 0x00 : 0x01;
+            connection->send (request::type::subscriptions, &packet, request::subscriptions::size (n));
+            n = 0;
         }
-        
-    } else {
+    }
+    this->report (log::level::note, 0x35, connection->peer, channels.size ());
+}
 
-        // if it's nested entry, provide whole thread
+void raddi::coordinator::process_subscriptions (connection * connection) {
+    struct state {
+        std::uint32_t threshold;
+        std::uint32_t number;
+        std::uint32_t count;
+    };
 
-        db::row row;
-        if (this->database.data->get (download->parent, &row)) {
-            parent = row.top ().thread;
+    std::map <eid, state> channels;
+    {
+        std::vector <struct request::subscriptions::channel> requested;
+        requested.swap (connection->catchup.channels);
+
+        for (const auto & channel : requested) {
+            channels [channel.channel] = { channel.threshold, channel.number, 0 };
         }
+    }
+    if (channels.empty ())
+        return;
 
-        // descending entries cannot be older than their parent
+    const auto now = raddi::now ();
+    auto oldest = channels.cbegin ()->second.threshold;
+    auto latest = channels.cbegin ()->second.threshold;
 
-        if (raddi::older (threshold, parent.timestamp)) {
-            threshold = parent.timestamp;
+    for (const auto & channel : channels) {
+        if (raddi::older (channel.second.threshold, oldest)) {
+            oldest = channel.second.threshold;
+        }
+        if (raddi::older (latest, channel.second.threshold)) {
+            latest = channel.second.threshold;
         }
     }
 
-    auto decission = [] (const auto & row, const auto & detail) {
-        return true;
+    auto find = [&channels] (const auto & row) -> state * {
+        auto i = channels.find (row.top ().channel);
+        if (i == channels.end ()) {
+            i = channels.find (row.top ().thread);
+        }
+        return (i != channels.end ()) ? &i->second : nullptr;
     };
     auto transmitter = [connection] (const auto & row, const auto & detail, std::uint8_t * data) {
-        connection->send (data, (std::size_t) row.data.length + sizeof (raddi::entry));
+        if (!connection->send (data, (std::size_t) row.data.length + sizeof (raddi::entry), raddi::connection::priority::bulk))
+            throw false; // transmission queue is full, see 'connection::overflows'
     };
 
-    if (parent.isnull ()) {
-        auto unconstrained = [] (const auto & row, const auto & detail) {
-            return true;
-        };
-        this->report (log::level::note, 0x29, connection->peer, threshold, now);
-        this->database.data->select (threshold, now, unconstrained, decission, transmitter);
+    // count what we have for all channels in single pass over the index
+    //  - channels in which the peer has as many entries as we do, or more, are not transmitted
+
+    this->database.data->select (oldest, now,
+                                 [&find] (const auto & row, const auto &) {
+                                     if (auto s = find (row)) {
+                                         if (!raddi::older (row.id.timestamp, s->threshold)) {
+                                             ++s->count;
+                                         }
+                                     }
+                                     return false;
+                                 },
+                                 [] (const auto &, const auto &) { return false; },
+                                 [] (const auto &, const auto &, std::uint8_t *) {});
+
+    // channels that differ
+    //  - single span doesn't say where the peer misses entries, so if it has enough of them,
+    //    ask for breakdown, the same as 'process_history_spans' does, see 'process_breakdown'
+    //  - in the rest the whole span is transmitted
+
+    std::size_t differ = 0;
+    std::size_t elaborated = 0;
+
+    for (auto & channel : channels) {
+        if (channel.second.count > channel.second.number) {
+            ++differ;
+
+            if ((channel.second.number >= request::elaboration::minimum) && (channel.second.threshold != now)) {
+                request::elaboration elaboration;
+                elaboration.channel = channel.first;
+                elaboration.oldest = channel.second.threshold;
+                elaboration.latest = now;
+
+                if (connection->send (request::type::elaborate, &elaboration, sizeof elaboration)) {
+                    channel.second.count = 0;
+                    ++elaborated;
+                }
+            }
+        } else {
+            channel.second.count = 0;
+        }
+    }
 
-    } else {
-        auto constrain = [parent] (const auto & row, const auto & detail) {
-            return parent == row.top ().channel
-                || parent == row.top ().thread;
-        };
-        this->report (log::level::note, 0x28, connection->peer, threshold, now, parent);
-        this->database.data->select (threshold,  now, constrain, decission, transmitter);
+    // thread-level entries older than thresholds, like 'process_history' does for single subscription
+
+    std::size_t threads = 0;
+    std::size_t entries = 0;
+    try {
+        threads = this->database.threads->select (0, latest,
+                                                  [&find] (const auto & row, const auto &) {
+                                                      auto s = find (row);
+                                                      return s && raddi::older (row.id.timestamp, s->threshold);
+                                                  },
+                                                  [] (const auto &, const auto &) { return true; },
+                                                  transmitter);
+
+        // and everything since threshold in channels that differ
+
+        if (differ > elaborated) {
+            entries = this->database.data->select (oldest, now,
+                                                   [&find] (const auto & row, const auto &) {
+                                                       auto s = find (row);
+                                                       return s && s->count && !raddi::older (row.id.timestamp, s->threshold);
+                                                   },
+                                                   [] (const auto &, const auto &) { return true; },
+                                                   transmitter);
+        }
+    } catch (bool) {
+        // rest of the reply doesn't fit, peer can subscribe again
     }
+
+    this->report (log::level::note, 0x36, connection->peer, channels.size (), differ, elaborated, threads, entries);
 }
 
-bool raddi::coordinator::move (connection * connection, level new_level, std::uint16_t assessment) {
-    if (this->move (connection->peer, new_level, assessment, false)) {
-        connection->level = new_level;
-        return true;
+void raddi::coordinator::process_breakdown (const raddi::request::breakdown * breakdown, std::size_t size, connection * connection) {
+    auto map = breakdown->history.decode (size - sizeof (eid) - sizeof (std::uint32_t));
+    auto range = std::make_pair (breakdown->oldest, breakdown->history.threshold - 1);
+
+    if (map.empty ()) {
+
+        // peer has nothing in the range
+
+        map [range] = 0;
+    }
+    this->process_history_spans (breakdown->channel, map, true, range, connection);
+}
+
+bool raddi::coordinator::process_history_spans (const eid & channel, const std::map <std::pair <std::uint32_t, std::uint32_t>, std::uint32_t> & map,
+                                                bool elaborate, std::pair <std::uint32_t, std::uint32_t> range, connection * connection) {
+    auto constrain = [channel] (const auto & row, const auto & detail) {
+        return channel == row.top ().channel
+            || channel == row.top ().thread;
+    };
+    auto transmitter = [connection] (const auto & row, const auto & detail, std::uint8_t * data) {
+        if (!connection->send (data, (std::size_t) row.data.length + sizeof (raddi::entry), raddi::connection::priority::bulk))
+            throw false; // transmission queue is full, see 'connection::overflows'
+    };
+
+    for (const auto & m : map) {
+
+        // spans of breakdown outside of elaborated range are ignored
+
+        if (range.first || range.second) {
+            if (raddi::older (m.first.first, range.first) || raddi::older (range.second, m.first.second))
+                continue;
+        }
+
+        auto n = this->database.data->select (m.first.first, m.first.second, constrain,
+                                              [] (const auto & row, const auto & detail) { return false; },
+                                              [] (const auto & row, const auto & detail, std::uint8_t *) {});
+
+        this->report (log::level::note, 0x27, connection->peer, channel, m.first.first, m.first.second, m.second, n);
+
+        // if we have more entries than peer does
+        //  - ask the peer to break the span down, unless it's too short or small,
+        //    or it's the whole range the peer already broke down (nothing to divide)
+
+        if (n > m.second) {
+            if (elaborate
+                    && (m.second >= request::elaboration::minimum)
+                    && (m.first.first != m.first.second)
+                    && (m.first != range)) {
+
+                request::elaboration elaboration;
+                elaboration.channel = channel;
+                elaboration.oldest = m.first.first;
+                elaboration.latest = m.first.second;
+
+                connection->send (request::type::elaborate, &elaboration, sizeof elaboration);
+            } else {
+                try {
+                    this->database.data->select (m.first.first, m.first.second, constrain,
+                                                 [] (const auto & row, const auto & detail) { return true; },
+                                                 transmitter);
+                } catch (bool) {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+bool raddi::coordinator::process_download_request (const request::download * download, connection * connection,
+                                                   const eid * position, std::uint32_t latest, bool unlimited) {
+    auto now = raddi::now ();
+    auto parent = download->parent;
+    auto threshold = download->threshold;
+
+    if (parent.isnull ()) {
+        if (!this->settings.full_database_downloads_allowed) {
+            this->report (log::level::data, 0x26, connection->peer);
+            return false;
+        }
+
+        // check against limit for full download
+
+        if (!unlimited && (now - threshold > this->settings.full_database_download_limit)) {
+            threshold = now - this->settings.full_database_download_limit;
+        }
+        
+    } else {
+
+        // if it's nested entry, provide whole thread
+
+        db::row row;
+        if (this->database.data->get (download->parent, &row)) {
+            parent = row.top ().thread;
+        }
+
+        // descending entries cannot be older than their parent
+
+        if (raddi::older (threshold, parent.timestamp)) {
+            threshold = parent.timestamp;
+        }
+    }
+
+    // queue cursor
+    //  - entries are not transmitted here, but streamed in chunks, see 'stream'
+    //  - resumed position is ignored if it's beyond what the peer is allowed to download
+
+    raddi::connection::cursor cursor;
+    cursor.parent = parent;
+    cursor.threshold = threshold;
+    cursor.latest = now;
+
+    if (latest && raddi::older (latest, now)) {
+        cursor.latest = latest;
+    }
+    if (position && !raddi::older (position->timestamp, threshold)) {
+        cursor.position = *position;
+    } else {
+        std::memset (&cursor.position, 0, sizeof cursor.position);
+    }
+
+    // channel and thread downloads are served from IDs cached from single scan, if possible
+
+    if (!parent.isnull () && !latest) {
+        cursor.ids = this->scan_download (parent, threshold, &cursor.latest, &cursor.pending);
+    }
+
+    {
+        exclusive guard (connection->cursors.lock);
+        if (connection->cursors.queue.size () >= this->settings.max_concurrent_downloads) {
+            this->report (log::level::data, 0x27, connection->peer, connection->cursors.queue.size ());
+            return false;
+        }
+        connection->cursors.queue.push_back (cursor);
+    }
+
+    if (parent.isnull ()) {
+        this->report (log::level::note, 0x29, connection->peer, threshold, now);
+    } else {
+        this->report (log::level::note, 0x28, connection->peer, threshold, now, parent);
+    }
+    return true;
+}
+
+std::shared_ptr <const std::vector <raddi::eid>>
+raddi::coordinator::scan_download (const eid & parent, std::uint32_t threshold, std::uint32_t * latest,
+                                   std::shared_future <std::shared_ptr <const std::vector <eid>>> * waiting) {
+    if (!this->settings.download_cache_lifetime || !this->settings.download_cache_limit)
+        return nullptr;
+
+    const auto now = raddi::now ();
+    const auto key = std::make_pair (parent, threshold);
+
+    std::promise <std::shared_ptr <const std::vector <eid>>> promise;
+    std::uint64_t scan = 0;
+    {
+        std::shared_future <std::shared_ptr <const std::vector <eid>>> pending;
+        {
+            exclusive guard (this->downloads.lock);
+
+            auto i = this->downloads.map.find (key);
+            if (i != this->downloads.map.end ()) {
+                if (!raddi::older (i->second.latest, now - this->settings.download_cache_lifetime)) {
+                    if (i->second.ids) {
+                        this->report (log::level::note, 0x34, parent, threshold, i->second.ids->size ());
+                        *latest = i->second.latest;
+                        return i->second.ids;
+                    }
+                    pending = i->second.pending;
+                    *latest = i->second.latest;
+                } else {
+                    this->downloads.size -= i->second.size ();
+                    this->downloads.map.erase (i);
+                }
+            }
+
+            // register pending scan, so that identical requests wait for it instead of scanning too
+
+            if (!pending.valid ()) {
+                try {
+                    auto & registered = this->downloads.map [key];
+                    registered.pending = promise.get_future ().share ();
+                    registered.latest = now;
+                    registered.scan = scan = ++this->downloads.scans;
+                    this->downloads.empty.store (false, std::memory_order_relaxed);
+                } catch (const std::bad_alloc &) {
+                    return nullptr;
+                }
+            }
+        }
+
+        if (pending.valid ()) {
+            *waiting = std::move (pending);
+            return nullptr;
+        }
+    }
+
+    // scan
+    //  - only index is read, entries are retrieved by ID when streaming
+    //  - too large results are not cached, streamed by 'select' in chunks instead
+    //  - waiting requests are released with the result (or null) before it's cached
+
+    const std::size_t limit = this->settings.download_cache_limit / 16u;
+    std::shared_ptr <std::vector <eid>> ids;
+    try {
+        ids = std::make_shared <std::vector <eid>> ();
+        this->database.data->select (threshold, now,
+                                     [parent, limit, &ids] (const auto & row, const auto & detail) {
+                                         if (parent == row.top ().channel || parent == row.top ().thread) {
+                                             if (ids->size () >= limit)
+                                                 throw false;
+
+                                             ids->push_back (row.id);
+                                         }
+                                         return false;
+                                     },
+                                     [] (const auto & row, const auto & detail) { return false; },
+                                     [] (const auto & row, const auto & detail, std::uint8_t *) {});
+    } catch (bool) {
+        ids = nullptr;
+    } catch (const std::bad_alloc &) {
+        ids = nullptr;
+    }
+
+    promise.set_value (ids);
+    *latest = now;
+
+    // insert, evicting expired, and then arbitrary ones, to fit the limit
+    //  - unless the pending registration was meanwhile invalidated by 'inserted' or evicted
+
+    exclusive guard (this->downloads.lock);
+
+    auto registered = this->downloads.map.find (key);
+    if ((registered == this->downloads.map.end ()) || (registered->second.scan != scan))
+        return ids;
+
+    if (!ids) {
+        this->downloads.map.erase (registered);
+    } else {
+        registered->second.pending = std::shared_future <std::shared_ptr <const std::vector <eid>>> ();
+
+        for (auto i = this->downloads.map.begin (); i != this->downloads.map.end (); ) {
+            if (i->second.ids && raddi::older (i->second.latest, now - this->settings.download_cache_lifetime)) {
+                this->downloads.size -= i->second.size ();
+                i = this->downloads.map.erase (i);
+            } else {
+                ++i;
+            }
+        }
+        for (auto i = this->downloads.map.begin (); (i != this->downloads.map.end ())
+                                                 && (this->downloads.size + ids->size () > this->settings.download_cache_limit); ) {
+            if (i->second.ids) {
+                this->downloads.size -= i->second.size ();
+                i = this->downloads.map.erase (i);
+            } else {
+                ++i;
+            }
+        }
+
+        if (this->downloads.size + ids->size () <= this->settings.download_cache_limit) {
+            registered->second.ids = ids;
+            this->downloads.size += ids->size ();
+        } else {
+            this->downloads.map.erase (registered);
+        }
+    }
+
+    this->downloads.empty.store (this->downloads.map.empty (), std::memory_order_relaxed);
+    return ids;
+}
+
+void raddi::coordinator::inserted (const db::root & top) {
+    if (this->downloads.empty.load (std::memory_order_relaxed))
+        return;
+
+    exclusive guard (this->downloads.lock);
+
+    for (const auto & parent : { top.channel, top.thread }) {
+        auto i = this->downloads.map.lower_bound (std::make_pair (parent, std::uint32_t (0)));
+        while ((i != this->downloads.map.end ()) && (i->first.first == parent)) {
+            this->downloads.size -= i->second.size ();
+            i = this->downloads.map.erase (i);
+        }
+    }
+
+    this->downloads.empty.store (this->downloads.map.empty (), std::memory_order_relaxed);
+}
+
+bool raddi::coordinator::synchronize (connection * connection) {
+    exclusive guard (this->synchronization.lock);
+    auto & partitions = this->synchronization.partitions;
+
+    // split the range on first core node connection
+    //  - with snapshot synchronization the first core node is asked for manifest of its shards first,
+    //    only shards that differ, and the range after them, are split into partitions then
+
+    if (this->core_sync_count) {
+        if (this->settings.snapshot_synchronization && !this->synchronization.requested && connection->partitioning) {
+            std::uint32_t oldest = this->database.data->empty () ? 0 : this->core_sync_threshold;
+
+            if (connection->send (request::type::snapshot, &oldest, sizeof oldest)) {
+                this->report (log::level::note, 0x33, connection->peer, oldest);
+
+                this->synchronization.snapshot = connection;
+                this->synchronization.deadline = raddi::now () + this->settings.partition_timeout;
+                this->synchronization.covered = oldest;
+                this->synchronization.requested = true;
+            }
+            return false;
+        }
+        if (this->synchronization.snapshot)
+            return false; // manifest not yet complete
+
+        const auto oldest = this->synchronization.requested ? this->synchronization.covered : this->core_sync_threshold;
+        const auto now = raddi::now ();
+
+        if (!raddi::older (now, oldest)) {
+            const auto span = (now - oldest) / this->core_sync_count + 1;
+
+            for (auto i = 0u; i != this->core_sync_count; ++i) {
+                const auto first = oldest + i * span;
+                const auto last = (i == this->core_sync_count - 1) ? now : first + span - 1;
+
+                if (!this->schedule_partition (first, last, 0))
+                    return false;
+            }
+        }
+        this->core_sync_count = 0;
+    }
+
+    // core node not serving partitions is asked for plain download of everything
+    //  - since the oldest partition not yet complete, the node streams it all at once
+
+    if (!connection->partitioning) {
+        if (this->synchronization.downloads < coordinator::partition::max_downloads) {
+            request::download download;
+            std::memset (&download.parent, 0, sizeof download.parent);
+            download.threshold = 0;
+
+            bool pending = false;
+            for (const auto & partition : partitions) {
+                if (!partition.complete && (!pending || raddi::older (partition.oldest, download.threshold))) {
+                    download.threshold = partition.oldest;
+                    pending = true;
+                }
+            }
+            if (pending && connection->send (request::type::download, &download, sizeof download)) {
+                this->report (log::level::note, 0x38, connection->peer, download.threshold);
+                this->synchronization.downloads++;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // one partition per core node at a time, none for node that stalled
+
+    for (const auto & partition : partitions) {
+        if (partition.source == connection)
+            return false;
+    }
+    for (const auto stalled : this->synchronization.stalled) {
+        if (stalled == connection)
+            return false;
+    }
+
+    for (auto & partition : partitions) {
+        if (!partition.complete && !partition.source
+                && (partition.attempts < coordinator::partition::max_attempts)
+                && (partition.excluded != connection->peer)) {
+
+            request::partition packet;
+            packet.oldest = partition.oldest;
+            packet.latest = partition.latest;
+            packet.position = partition.position;
+
+            if (connection->send (request::type::partition, &packet, sizeof packet)) {
+                this->report (log::level::note, 0x2F, connection->peer, partition.oldest, partition.latest, partition.attempts);
+
+                partition.source = connection;
+                partition.deadline = raddi::now () + this->settings.partition_timeout;
+                partition.attempts++;
+                return true;
+            } else
+                return false;
+        }
+    }
+    return false;
+}
+
+bool raddi::coordinator::is_core (const connection * connection) const {
+
+    // inbound connection is classified as core node by IP address only, see 'incomming'
+    //  - require it to at least complete protocol identification
+
+    return (connection->level == core_nodes)
+        && (connection->is_outbound () || connection->corroborated);
+}
+
+bool raddi::coordinator::schedule_partition (std::uint32_t oldest, std::uint32_t latest, std::uint32_t expected) {
+    coordinator::partition p;
+    p.oldest = oldest;
+    p.latest = latest;
+    std::memset (&p.position, 0, sizeof p.position);
+    std::memset (&p.excluded, 0, sizeof p.excluded);
+    p.expected = expected;
+    p.deadline = 0;
+    p.source = nullptr;
+    p.attempts = 0;
+    p.complete = false;
+
+    try {
+        this->synchronization.partitions.push_back (p);
+        return true;
+    } catch (const std::bad_alloc &) {
+        return false;
+    }
+}
+
+void raddi::coordinator::supervise_synchronization (std::uint32_t now) {
+    std::size_t expired = 0;
+    {
+        exclusive guard (this->synchronization.lock);
+
+        // manifest not completed in time, or its source disconnected, rest of the range is partitioned by time
+
+        if (this->synchronization.snapshot && raddi::older (this->synchronization.deadline, now)) {
+            this->report (log::level::data, 0x2C, this->synchronization.snapshot->peer, this->settings.partition_timeout, this->synchronization.covered);
+
+            try {
+                this->synchronization.stalled.push_back (this->synchronization.snapshot);
+            } catch (const std::bad_alloc &) {
+                // stalled node may get a partition
+            }
+            this->synchronization.snapshot = nullptr;
+        }
+        if (this->core_sync_count && this->synchronization.requested && !this->synchronization.snapshot) {
+            ++expired;
+        }
+
+        for (auto & partition : this->synchronization.partitions) {
+            if (partition.source && raddi::older (partition.deadline, now)) {
+                this->report (log::level::data, 0x2A, partition.source->peer, partition.oldest, partition.latest, this->settings.partition_timeout);
+
+                try {
+                    this->synchronization.stalled.push_back (partition.source);
+                } catch (const std::bad_alloc &) {
+                    // stalled node may get another partition
+                }
+                partition.excluded = partition.source->peer;
+                partition.source = nullptr;
+                ++expired;
+            }
+        }
+    }
+
+    // stalled partitions continue from last position received on other core nodes
+    //  - 'synchronize' splits the range first, if not done yet
+
+    if (expired) {
+        immutability guard (this->lock);
+        for (auto & c : this->connections) {
+            if (c.secured && !c.retired && (c.level == core_nodes)) {
+                this->synchronize (&c);
+            }
+        }
+    }
+}
+
+void raddi::coordinator::process_snapshot_request (std::uint32_t oldest, connection * connection) {
+
+    // manifest beyond synchronization window would let peer make us digest whole table repeatedly
+
+    const auto window = raddi::now () - this->database.settings.synchronization_threshold;
+    if (raddi::older (oldest, window)) {
+        oldest = window;
+    }
+
+    std::vector <std::pair <std::uint32_t, std::uint32_t>> ranges;
+    std::vector <std::uint64_t> digests;
+    std::vector <std::size_t> numbers;
+    try {
+        std::uint32_t previous = 0;
+        bool first = true;
+
+        // newest shard is still being written into, it's not part of the snapshot
+
+        this->database.data->enumerate_shard_info ([&ranges, &previous, &first, oldest] (std::uint32_t base, std::size_t) {
+            if (!first && !raddi::older (base - 1, oldest)) {
+                ranges.push_back ({ previous, base - 1 });
+            }
+            previous = base;
+            first = false;
+            return true;
+        });
+
+        digests.resize (ranges.size ());
+        numbers.resize (ranges.size ());
+    } catch (const std::bad_alloc &) {
+        return;
+    }
+
+    this->digest_table_ranges (ranges.data (), ranges.size (), this->database.data.get (), digests.data (), numbers.data ());
+
+    request::manifest packet;
+    packet.flags = 0x00;
+
+    std::size_t n = 0;
+    std::size_t shards = 0;
+    std::size_t total = 0;
+
+    for (std::size_t i = 0; i != ranges.size (); ++i) {
+        packet.shard [n].oldest = ranges [i].first;
+        packet.shard [n].latest = ranges [i].second;
+        packet.shard [n].rows = (std::uint32_t) numbers [i];
+
+        for (auto b = 0u; b != sizeof packet.shard [n].digest; ++b) {
+            packet.shard [n].digest [b] = (digests [i] >> (8 * b)) & 0xFF;
+        }
+
+        ++shards;
+        total += numbers [i];
+
+        if (++n == request::manifest::max_shards) {
+            if (!connection->send (request::type::manifest, &packet, request::manifest::size (n)))
+                return;
+
+            n = 0;
+        }
+    }
+
+    packet.flags = 0x01;
+    connection->send (request::type::manifest, &packet, request::manifest::size (n));
+
+    this->report (log::level::note, 0x31, connection->peer, shards, total);
+}
+
+void raddi::coordinator::process_manifest (const request::manifest * manifest, std::size_t size, connection * connection) {
+    {
+        immutability guard (this->synchronization.lock);
+        if (this->synchronization.snapshot != connection)
+            return;
+    }
+
+    // our digests of the peer's shards, computed in single pass and without holding the lock
+    //  - shards must be sorted and not overlap, as the peer enumerates them
+
+    const std::size_t n = manifest->length (size);
+
+    std::pair <std::uint32_t, std::uint32_t> ranges [request::manifest::max_shards];
+    std::uint64_t digests [request::manifest::max_shards];
+    std::size_t numbers [request::manifest::max_shards];
+
+    for (std::size_t i = 0; i != n; ++i) {
+        ranges [i] = { manifest->shard [i].oldest, manifest->shard [i].latest };
+
+        if (i && !(ranges [i - 1].second < ranges [i].first))
+            return;
+    }
+
+    this->digest_table_ranges (ranges, n, this->database.data.get (), digests, numbers);
+
+    {
+        exclusive guard (this->synchronization.lock);
+        if (this->synchronization.snapshot != connection)
+            return;
+
+        this->synchronization.deadline = raddi::now () + this->settings.partition_timeout;
+
+        // shards that differ from ours become partitions to download
+        //  - rows reported by the peer are expected, as with 'tally'
+
+        std::size_t differ = 0;
+
+        for (std::size_t i = 0; i != n; ++i) {
+            const auto & shard = manifest->shard [i];
+            const auto digest = digests [i];
+            const auto number = numbers [i];
+
+            std::uint64_t remote = 0;
+            for (auto b = 0u; b != sizeof shard.digest; ++b) {
+                remote |= std::uint64_t (shard.digest [b]) << (8 * b);
+            }
+
+            if ((digest != remote) || (number != shard.rows)) {
+                this->schedule_partition (shard.oldest, shard.latest, shard.rows);
+                ++differ;
+            }
+
+            // peer clamps the request to its synchronization window, history before is split by time
+            if (raddi::older (this->synchronization.covered, shard.oldest)) {
+                this->schedule_partition (this->synchronization.covered, shard.oldest - 1, 0);
+            }
+            if (!raddi::older (shard.latest + 1, this->synchronization.covered)) {
+                this->synchronization.covered = shard.latest + 1;
+            }
+        }
+
+        this->report (log::level::note, 0x32, connection->peer, n, differ, this->synchronization.covered);
+
+        if (!(manifest->flags & 0x01))
+            return;
+
+        this->synchronization.snapshot = nullptr;
+    }
+
+    // manifest complete, distribute partitions among all connected core nodes
+
+    immutability guard (this->lock);
+    for (auto & c : this->connections) {
+        if (c.secured && !c.retired && (c.level == core_nodes)) {
+            this->synchronize (&c);
+        }
+    }
+}
+
+void raddi::coordinator::synchronized (connection * connection, const request::continuation * continuation) {
+    bool available = false;
+    {
+        exclusive guard (this->synchronization.lock);
+        for (auto & partition : this->synchronization.partitions) {
+            if (partition.source == connection) {
+
+                if (!continuation->position.isnull ()) {
+                    partition.position = continuation->position;
+                    partition.deadline = raddi::now () + this->settings.partition_timeout;
+                    break;
+                }
+
+                // partition streamed, verify we have at least what the source reported to have
+                //  - counts are approximate (histograms), so some tolerance is allowed
+
+                auto count = (std::uint32_t) this->database.data->count (partition.oldest, partition.latest);
+                if ((count + partition.expected / 64u < partition.expected) && (partition.attempts < coordinator::partition::max_attempts)) {
+                    this->report (log::level::data, 0x28, connection->peer, partition.oldest, partition.latest, count, partition.expected);
+
+                    std::memset (&partition.position, 0, sizeof partition.position);
+                    partition.excluded = connection->peer;
+                } else {
+                    this->report (log::level::note, 0x30, connection->peer, partition.oldest, partition.latest, count, partition.expected);
+                    partition.complete = true;
+                }
+                partition.source = nullptr;
+                available = true;
+                break;
+            }
+        }
+    }
+
+    // source is free to download another partition, including failed ones
+
+    if (available) {
+        this->synchronize (connection);
+    }
+}
+
+void raddi::coordinator::stream (connection * connection) {
+    exclusive guard (connection->cursors.lock);
+
+    auto & queue = connection->cursors.queue;
+    if (connection->retired) {
+        queue.clear ();
+        return;
+    }
+    if (queue.empty ())
+        return;
+
+    // pacing
+    //  - next chunk is streamed only when the previous one was mostly transmitted
+    //  - without the dispatcher timer to come back later, everything is streamed at once
+
+    const std::uint64_t pace = 50'000;
+    const std::size_t chunk = this->settings.download_chunk_size;
+
+    bool paced = chunk != 0;
+    if (paced && connection->backlogged () > chunk / 2) {
+        if (this->postpone (connection, raddi::microtimestamp (), pace))
+            return;
+
+        paced = false;
+    }
+
+    while (!queue.empty ()) {
+        auto & cursor = queue.front ();
+
+        // identical scan is in progress
+        //  - come back later, or stream by 'select' if it can't be waited for without blocking
+
+        if (cursor.pending.valid ()) {
+            if (cursor.pending.wait_for (std::chrono::seconds (0)) != std::future_status::ready) {
+                if (paced && this->postpone (connection, raddi::microtimestamp (), pace))
+                    return;
+            } else {
+                try {
+                    if ((cursor.ids = cursor.pending.get ())) {
+                        this->report (log::level::note, 0x34, cursor.parent, cursor.threshold, cursor.ids->size ());
+                    }
+                } catch (const std::future_error &) {
+                    // scan failed
+                }
+            }
+            cursor.pending = std::shared_future <std::shared_ptr <const std::vector <eid>>> ();
+        }
+
+        const auto parent = cursor.parent;
+        const auto position = cursor.position;
+
+        std::size_t n = 0;
+        std::size_t sent = 0;
+        bool finished = false;
+
+        auto constrain = [parent, position] (const auto & row, const auto & detail) {
+            return (position.isnull () || position < row.id)
+                && (parent.isnull () || parent == row.top ().channel || parent == row.top ().thread);
+        };
+        auto budget = [&sent, paced, chunk] (const auto & row, const auto & detail) {
+            if (paced && sent >= chunk)
+                throw false;
+
+            return true;
+        };
+        auto transmitter = [connection, &cursor, &n, &sent] (const auto & row, const auto & detail, std::uint8_t * data) {
+            auto size = (std::size_t) row.data.length + sizeof (raddi::entry);
+            if (!connection->send (data, size, raddi::connection::priority::bulk))
+                throw true;
+
+            cursor.position = row.id;
+            sent += size;
+            ++n;
+        };
+
+        try {
+            if (auto ids = cursor.ids) {
+                auto i = position.isnull () ? ids->begin ()
+                                            : std::upper_bound (ids->begin (), ids->end (), position);
+
+                for (; i != ids->end (); ++i) {
+                    if (paced && sent >= chunk)
+                        throw false;
+
+                    // entries erased since the scan are skipped
+
+                    std::uint8_t data [sizeof (raddi::entry) + raddi::entry::max_content_size];
+                    std::size_t size;
+
+                    if (this->database.data->get (*i, data, &size)) {
+                        if (!connection->send (data, size, raddi::connection::priority::bulk))
+                            throw true;
+
+                        sent += size;
+                        ++n;
+                    }
+                    cursor.position = *i;
+                }
+            } else {
+                if (position.isnull ()) {
+                    this->database.data->select (cursor.threshold, cursor.latest, constrain, budget, transmitter);
+                } else {
+                    this->database.data->select_after (position, cursor.latest, constrain, budget, transmitter);
+                }
+            }
+            finished = true;
+        } catch (bool failed) {
+            if (failed) {
+                queue.clear ();
+                return;
+            }
+        }
+
+        // continuation
+        //  - sent with bulk priority to arrive after the entries
+        //  - null position tells the peer the download is complete
+
+        request::continuation continuation;
+        continuation.parent = cursor.parent;
+
+        if (finished) {
+            std::memset (&continuation.position, 0, sizeof continuation.position);
+            this->report (log::level::note, 0x2E, connection->peer, cursor.parent, n, sent);
+            queue.pop_front ();
+        } else {
+            continuation.position = cursor.position;
+            this->report (log::level::note, 0x2D, connection->peer, cursor.parent, n, sent, continuation.position);
+        }
+        if (!connection->send (request::type::continuation, &continuation, sizeof continuation, raddi::connection::priority::bulk)) {
+            queue.clear ();
+            return;
+        }
+
+        if (paced && !queue.empty ()) {
+            if (this->postpone (connection, raddi::microtimestamp (), pace))
+                return;
+
+            paced = false;
+        }
+    }
+}
+
+bool raddi::coordinator::move (connection * connection, level new_level, std::uint16_t assessment) {
+    if (this->move (connection->peer, new_level, assessment, false)) {
+        connection->level = new_level;
+        this->tally (connection);
+        return true;
     } else
         return false;
 }
@@ -750,11 +2118,17 @@ bool raddi::coordinator::move (const address & address, level new_level, std::ui
     this->database.peers [new_level]->insert (address, assessment);
 
     if (adjust) {
+        raddi::address ip = address;
+        ip.port = 0;
+
         immutability guard (this->lock);
-        for (auto & connection : this->connections) {
-            if (!connection.retired) {
-                if (connection.peer == address) {
-                    connection.level = new_level;
+
+        auto range = this->directory.index.equal_range (ip);
+        for (auto i = range.first; i != range.second; ++i) {
+            if (!i->second->retired) {
+                if (i->second->peer == address) {
+                    i->second->level = new_level;
+                    this->tally (i->second);
                 }
             }
         }
@@ -791,21 +2165,29 @@ bool raddi::coordinator::incomming (Socket && prepared, const sockaddr * remote)
         }
 
         exclusive guard (this->lock);
-        return this->connections.emplace_front (std::move (prepared), remote, level).accepted ();
+        auto & connection = this->connections.emplace_front (std::move (prepared), remote, level);
+        this->track (&connection);
+        return connection.accepted ();
     } catch (const std::bad_alloc &) {
         return false;
     }
 }
 
 bool raddi::coordinator::inuse (const address & a) const {
+    immutability guard (this->lock);
+    return this->inuse (a, true);
+}
+
+bool raddi::coordinator::inuse (const address & a, bool retired) const {
     address a0 = a;
     a0.port = 0;
-    
-    immutability guard (this->lock);
 
-    for (const auto & connection : connections) {
-        if ((connection.peer == a) || (connection.peer == a0))
-            return true;
+    auto range = this->directory.index.equal_range (a0);
+    for (auto i = range.first; i != range.second; ++i) {
+        if ((i->second->peer == a) || (i->second->peer == a0)) {
+            if (retired || !i->second->retired)
+                return true;
+        }
     }
     return false;
 }
@@ -853,17 +2235,11 @@ bool raddi::coordinator::reciprocal (const connection * peer) {
 
     immutability guard (this->lock);
 
-    for (const auto & connection : connections) {
-        if (connection.secured) {
-            if (&connection != peer) {
-                address addr = connection.peer;
-                addr.port = 0;
-
-                if (addr == other) {
-                    this->report (log::level::event, 0x25, connection.peer, 28);;
-                    return true;
-                }
-            }
+    auto range = this->directory.index.equal_range (other);
+    for (auto i = range.first; i != range.second; ++i) {
+        if (i->second->secured && (i->second != peer)) {
+            this->report (log::level::event, 0x25, i->second->peer, 28);;
+            return true;
         }
     }
     return false;
@@ -871,29 +2247,17 @@ bool raddi::coordinator::reciprocal (const connection * peer) {
 std::size_t raddi::coordinator::active (std::size_t attempting [levels],
                                         std::size_t connected [levels]) const {
     std::size_t n = 0;
+
+    immutability guard (this->directory.lock);
+
     if (attempting) {
-        std::memset (attempting, 0, levels * sizeof (std::size_t));
+        std::memcpy (attempting, this->directory.attempting, levels * sizeof (std::size_t));
     }
     if (connected) {
-        std::memset (connected, 0, levels * sizeof (std::size_t));
+        std::memcpy (connected, this->directory.connected, levels * sizeof (std::size_t));
     }
-
-    immutability guard (this->lock);
-
-    for (const auto & connection : connections) {
-        if (!connection.retired) {
-            if (connection.connecting) {
-                if (attempting) {
-                    ++attempting [connection.level];
-                }
-            }
-            if (connection.secured) {
-                ++n;
-                if (connected) {
-                    ++connected [connection.level];
-                }
-            }
-        }
+    for (auto level = 0; level != levels; ++level) {
+        n += this->directory.connected [level];
     }
     return n;
 }
@@ -913,26 +2277,195 @@ void raddi::coordinator::status () const {
     }
 }
 
-std::size_t raddi::coordinator::broadcast (const db::root & top, const entry * data, std::size_t size) {
+std::size_t raddi::coordinator::broadcast (const db::root & top, const entry * data, std::size_t size, bool relayed) {
     const bool announcement = data->is_announcement ();
-    std::size_t n = 0;
+    const auto priority = announcement ? raddi::connection::priority::announcement
+                                       : raddi::connection::priority::propagation;
+    const auto delay = relayed ? this->settings.relayed_broadcast_delay
+                               : this->settings.broadcast_delay;
 
     immutability guard (this->lock);
-    for (auto & connection : connections) {
+
+    std::vector <connection *> recipients;
+    for (auto & connection : this->connections) {
         if (connection.secured && !connection.retired) {
+            if (announcement || connection.subscriptions.is_subscribed ({ top.channel, top.thread, data->parent, data->id })) {
+                recipients.push_back (&connection);
+            }
+        }
+    }
 
-            // TODO: send to someone immediately and to others with slight delay (up to 1s?) to mess with origin analysis - Aetheral Research
-            //        - this will come in hand with the queuing feature described in .send function comments
-            //        - shorter randomized delay for retransmitted messages than for original ones
+    if (recipients.empty ())
+        return 0;
 
-            if (announcement || connection.subscriptions.is_subscribed ({ top.channel, top.thread, data->parent, data->id })) {
-                n += connection.send (data, size);
+    // send to someone immediately and to others with slight random delay to mess with origin analysis - Aetheral Research
+    //  - entries delayed for single connection are coalesced and transmitted together on 'dispatch'
+    //  - connection that already holds delayed entries gets this one in the same batch
+
+    const auto now = raddi::microtimestamp ();
+    const auto immediate = this->random_distribution (this->random_generator) % recipients.size ();
+
+    std::size_t n = 0;
+    for (std::size_t i = 0; i != recipients.size (); ++i) {
+        auto connection = recipients [i];
+
+        if ((i == immediate) || (delay == 0)) {
+            n += connection->send (data, size, priority);
+        } else {
+            switch (connection->delay (data, size, priority)) {
+                case 1:
+                    if (!this->postpone (connection, now, this->random_distribution (this->random_generator) % (1000uLL * delay))) {
+                        connection->release ();
+                    }
+                    [[ fallthrough ]];
+                case 0:
+                    ++n;
             }
         }
     }
     return n;
 }
 
+bool raddi::coordinator::postpone (connection * connection, std::uint64_t now, std::uint64_t delay) {
+    exclusive guard (this->postponed.lock);
+    if (!this->postponed.timer)
+        return false;
+
+    try {
+        auto deadline = this->postponed.wheel.schedule (now, delay, connection);
+        connection->scheduled++;
+        if (!this->postponed.armed || (deadline < this->postponed.armed)) {
+            this->arm (now, deadline);
+        }
+        return true;
+    } catch (const std::bad_alloc &) {
+        return false;
+    }
+}
+
+void raddi::coordinator::dispatch () {
+    const auto now = raddi::microtimestamp ();
+
+    // connections are released while holding 'postponed.lock' which
+    // is never requested while holding connection's transmitter lock
+
+    immutability guard (this->lock);
+    std::vector <connection *> streaming;
+    {
+        exclusive guard2 (this->postponed.lock);
+
+        this->postponed.wheel.advance (now, [&streaming] (connection * connection) {
+            connection->scheduled--;
+            if (connection->retired)
+                return;
+
+            connection->release ();
+            connection->resume ();
+
+            try {
+                streaming.push_back (connection);
+            } catch (const std::bad_alloc &) {
+                // download stalls until peer requests something
+            }
+        });
+        this->postponed.armed = 0;
+
+        if (auto next = this->postponed.wheel.next ()) {
+            this->arm (now, next);
+        }
+    }
+
+    // continue streaming downloads paced by 'stream'
+    //  - outside of 'postponed.lock' as streaming may postpone the connection again
+
+    for (auto connection : streaming) {
+        this->stream (connection);
+    }
+}
+
+std::uint64_t raddi::coordinator::throttle (connection * connection) {
+    auto & credit = connection->credit;
+    if (!credit.entries || !this->settings.receive_credit)
+        return 0;
+
+    // fold measured processing time into the moving average
+
+    std::uint64_t latency = credit.elapsed / credit.entries;
+    if (credit.latency) {
+        credit.latency = (7 * credit.latency + latency) / 8;
+    } else {
+        credit.latency = latency;
+    }
+    const auto average = credit.latency;
+
+    credit.elapsed = 0;
+    credit.entries = 0;
+
+    // credit rate, reduced when the pipeline lags, down to 1/16
+
+    std::uint64_t rate = this->settings.receive_credit;
+    if (average > this->settings.receive_latency_target) {
+        rate = rate * this->settings.receive_latency_target / average;
+        if (rate < this->settings.receive_credit / 16u) {
+            rate = this->settings.receive_credit / 16u;
+        }
+    }
+    if (rate == 0) {
+        rate = 1;
+    }
+
+    // replenish, at most one second worth of credit is accumulated
+
+    const auto now = raddi::microtimestamp ();
+    if (credit.replenished) {
+        const auto elapsed = std::min <std::uint64_t> (now - credit.replenished, 1'000'000u);
+
+        credit.balance += (std::int64_t) (elapsed * rate / 1'000'000u);
+        if (credit.balance > (std::int64_t) rate) {
+            credit.balance = (std::int64_t) rate;
+        }
+    } else {
+        credit.balance += (std::int64_t) rate;
+    }
+    credit.replenished = now;
+
+    if (credit.balance > 0)
+        return 0;
+    else
+        return (std::uint64_t) (-credit.balance) * 1'000'000u / rate + 1;
+}
+
+bool raddi::coordinator::suspend (connection * connection, std::uint64_t delay) {
+    return this->postpone (connection, raddi::microtimestamp (), delay);
+}
+
+bool raddi::coordinator::resumable (const address & address, protocol::ticket * ticket, std::uint8_t * secret) {
+    if (protocol::resumption::lifetime) {
+        exclusive guard (this->tickets.lock);
+
+        auto i = this->tickets.map.find (address);
+        if (i != this->tickets.map.end ()) {
+            const auto valid = !raddi::older (i->second.received, raddi::now () - protocol::resumption::lifetime);
+            if (valid) {
+                std::memcpy (ticket, &i->second.ticket, sizeof i->second.ticket);
+                std::memcpy (secret, i->second.secret, sizeof i->second.secret);
+            }
+            this->tickets.map.erase (i);
+            return valid;
+        }
+    }
+    return false;
+}
+
+void raddi::coordinator::arm (std::uint64_t now, std::uint64_t deadline) {
+    LARGE_INTEGER due;
+    due.QuadPart = -10 * (LONGLONG) ((deadline > now) ? (deadline - now) : 1);
+
+    if (SetWaitableTimer (this->postponed.timer, &due, 0, NULL, NULL, FALSE)) {
+        this->postponed.armed = deadline;
+    }
+}
+
 std::size_t raddi::coordinator::broadcast (enum class raddi::request::type rq, const void * data, std::size_t size) {
     std::size_t n = 0;
 
@@ -947,9 +2480,17 @@ std::size_t raddi::coordinator::broadcast (enum class raddi::request::type rq, c
 
 void raddi::coordinator::established (connection * connection) {
 
+    // announce batched subscriptions ahead of everything, the peer subscribes when it receives 'initial'
+    connection->send (request::type::catchup);
+    connection->send (request::type::partitioning);
+
     // exchange protocol strings to verify encryption works correctly
     connection->send (request::type::initial, raddi::protocol::magic, sizeof raddi::protocol::magic);
 
+    // let peer know we can receive multiple entries in single, possibly compressed, frame
+    connection->send (request::type::batching);
+    connection->send (request::type::compression);
+
     if (connection->is_outbound ()) {
         // update level for successful outbound connection
         switch (connection->level) {
@@ -984,6 +2525,15 @@ void raddi::coordinator::established (connection * connection) {
 
 void raddi::coordinator::corroborated (connection * connection) {
 
+    // issue resumption ticket to inbound peer, so it can reconnect faster
+
+    if (connection->is_inbound () && protocol::resumption::lifetime) {
+        protocol::ticket ticket;
+        if (protocol::resumption::issue (connection->resumption, &ticket)) {
+            connection->send (request::type::ticket, &ticket, sizeof ticket);
+        }
+    }
+
     // request identities and channels we may have missed
 
     this->report_table_history (connection, request::type::identities, this->database.identities.get ());
@@ -996,35 +2546,30 @@ void raddi::coordinator::corroborated (connection * connection) {
     //     - request data on identity channels only from core nodes (hopefully trustworthy)
     //       to limit potential of discovering real-world identity between peers
 
+    //  - peers that serve batched 'subscriptions' get all channels at once, see 'gather_subscriptions'
+
     if (this->settings.network_propagation_participation) {
         connection->send (request::type::everything);
     }
-    this->subscriptions.enumerate ([this, connection] (auto eid) {
-        if ((eid.timestamp != eid.identity.timestamp) || (connection->level == core_nodes)) {
-                
-            request::subscription packet;
-            if (auto size = this->gather_history (eid, &packet)) {
-                connection->send (request::type::subscribe, &packet, size);
+    if (connection->catchup.supported) {
+        this->gather_subscriptions (connection);
+    } else {
+        this->subscriptions.enumerate ([this, connection] (auto eid) {
+            if ((eid.timestamp != eid.identity.timestamp) || (connection->level == core_nodes)) {
+
+                request::subscription packet;
+                if (auto size = this->gather_history (eid, &packet, request::subscription::compatible_depth)) {
+                    connection->send (request::type::subscribe, &packet, size);
+                }
             }
-        }
-    });
+        });
+    }
 
     // core nodes sync
-    //  - if connected to core node, and we allow full download queries, send one
+    //  - if connected to core node, and we allow full download queries, ask it for a partition
 
     if ((connection->level == core_nodes) && this->settings.full_database_downloads_allowed) {
-        if (auto ncs = this->core_sync_count) {
-
-            request::download download;
-            download.parent.timestamp = 0;
-            download.parent.identity.timestamp = 0;
-            download.parent.identity.nonce = 0;
-            download.threshold = this->core_sync_threshold;
-            
-            if (connection->send (request::type::download, &download, sizeof download)) {
-                this->core_sync_count = ncs - 1;
-            }
-        }
+        this->synchronize (connection);
     }
 }
 
@@ -1037,7 +2582,26 @@ void raddi::coordinator::subscribe (const uuid & app, const eid & subscription)
 
         request::subscription packet;
         if (auto size = this->gather_history (subscription, &packet)) {
-            this->broadcast (request::type::subscribe, &packet, size);
+
+            // older peers (not announcing 'catchup') would reject history longer than 'compatible_depth'
+
+            request::subscription compatible;
+            auto compatible_size = size;
+
+            if (size > request::subscription::size (request::subscription::compatible_depth)) {
+                compatible_size = this->gather_history (subscription, &compatible, request::subscription::compatible_depth);
+            }
+
+            immutability guard (this->lock);
+            for (auto & connection : this->connections) {
+                if (connection.secured && !connection.retired) {
+                    if (connection.catchup.supported || (compatible_size == size)) {
+                        connection.send (request::type::subscribe, &packet, size);
+                    } else {
+                        connection.send (request::type::subscribe, &compatible, compatible_size);
+                    }
+                }
+            }
         }
     }
 }
@@ -1117,6 +2681,10 @@ void raddi::coordinator::report_table_history (raddi::connection * connection, e
 
     history.flags = s.flags;
 
+    if (this->settings.channels_reconciliation) {
+        history.flags |= 0x0002;
+    }
+
     auto i = s.length;
     auto tx = s.threshold;
     while (i--) {
@@ -1144,7 +2712,7 @@ void raddi::coordinator::report_table_history (raddi::connection * connection, e
                   s.length, s.total, s.sources, history.size (s.length));
 }
 
-std::size_t raddi::coordinator::gather_history (const eid & channel, raddi::request::subscription * result) const {
+std::size_t raddi::coordinator::gather_history (const eid & channel, raddi::request::subscription * result, std::size_t depth) const {
     struct state {
         bool first_iteration = true;
         std::uint32_t now = raddi::now ();
@@ -1167,7 +2735,7 @@ std::size_t raddi::coordinator::gather_history (const eid & channel, raddi::requ
                 return channel == row.top ().channel
                     || channel == row.top ().thread;
             },
-            [this, &s, &total] (const auto & row, const auto & detail) {
+            [this, &s, &total, depth] (const auto & row, const auto & detail) {
                 const auto t = row.id.timestamp;
 
                 if (s.first_iteration) {
@@ -1183,7 +2751,7 @@ std::size_t raddi::coordinator::gather_history (const eid & channel, raddi::requ
                     ++s.numbers [s.length];
                 } else {
                     s.threshold = t;
-                    if (++s.length < request::history::depth) {
+                    if (++s.length < depth) {
                         s.numbers [s.length] = 0;
                         s.thresholds [s.length] = t;
                     } else {
@@ -1209,13 +2777,12 @@ std::size_t raddi::coordinator::gather_history (const eid & channel, raddi::requ
         result->history.threshold = s.threshold;
     }
 
-    /* // TODO: enable this when supported
     for (auto i = 0u; i != s.length; ++i) {
         if (s.numbers [i] != 0) {
             result->history.flags = 0x0001; // could be further elaborated
             break;
         }
-    }// */
+    }
 
     auto i = s.length;
     auto tx = s.threshold;
@@ -1236,7 +2803,7 @@ std::size_t raddi::coordinator::gather_history (const eid & channel, raddi::requ
         tx = s.thresholds [i];
     }
 
-    auto size = result->history.size (s.length);
+    auto size = request::subscription::size (s.length);
     this->report (log::level::event, 0x29,
                   channel,
                   s.length ? s.thresholds [0] : 0, result->history.threshold,
@@ -1245,6 +2812,68 @@ std::size_t raddi::coordinator::gather_history (const eid & channel, raddi::requ
     return size;
 }
 
+std::size_t raddi::coordinator::gather_breakdown (const eid & channel, std::uint32_t oldest, std::uint32_t latest,
+                                                  raddi::request::breakdown * result) const {
+    const auto width = std::uint64_t (latest - oldest) + 1;
+    const auto k = (std::size_t) std::min (width, std::uint64_t (request::breakdown::depth));
+
+    // count entries in 'k' equal parts of the range
+
+    std::size_t numbers [request::breakdown::depth] = {};
+    std::size_t total = this->database.data->select (oldest, latest,
+        [&channel] (const auto & row, const auto &) {
+            return channel == row.top ().channel
+                || channel == row.top ().thread;
+        },
+        [oldest, width, k, &numbers] (const auto & row, const auto &) {
+            ++numbers [std::uint64_t (row.id.timestamp - oldest) * k / width];
+            return false;
+        },
+        [] (const auto &, const auto & detail, std::uint8_t *) {}
+    );
+
+    std::memset (result, 0, sizeof *result);
+    result->channel = channel;
+    result->oldest = oldest;
+    result->history.threshold = latest + 1;
+
+    // merge parts into spans
+    //  - number of entries in span is encoded with offset 1, so parts without entries
+    //    are merged into the following one, trailing ones into the last
+
+    std::uint32_t begins [request::breakdown::depth];
+    std::size_t length = 0;
+    std::uint32_t begin = oldest;
+
+    for (auto i = 0u; i != k; ++i) {
+        if (numbers [i]) {
+            begins [length] = begin;
+            numbers [length] = numbers [i];
+            begin = oldest + std::uint32_t ((width * (i + 1) + k - 1) / k);
+            ++length;
+        }
+    }
+
+    for (auto i = 0u; i != length; ++i) {
+        const auto end = (i + 1 != length) ? begins [i + 1] - 1 : latest;
+        const auto t = end - begins [i];
+        result->history.span [i].threshold [0] = (t >> 0) & 0xFF;
+        result->history.span [i].threshold [1] = (t >> 8) & 0xFF;
+        result->history.span [i].threshold [2] = (t >> 16) & 0xFF;
+
+        auto n = numbers [i] - 1;
+        if (n > 0x00FFFFFF) {
+            n = 0x00FFFFFF;
+        }
+        result->history.span [i].number [0] = (n >> 0) & 0xFF;
+        result->history.span [i].number [1] = (n >> 8) & 0xFF;
+        result->history.span [i].number [2] = (n >> 16) & 0xFF;
+    }
+
+    this->report (log::level::event, 0x29, channel, oldest, latest, length, total, request::breakdown::size (length));
+    return request::breakdown::size (length);
+}
+
 void raddi::coordinator::announce (const address & a, bool only, connection * cx) {
     union {
         request::newpeer common;
@@ -1336,6 +2965,20 @@ void raddi::coordinator::unavailable (const connection * connection) {
 }
 
 void raddi::coordinator::disagreed (const connection * connection) {
+    if (connection->resuming) {
+
+        // peer likely restarted and no longer knows the ticket we presented
+        //  - the ticket was already dropped by 'resumable', so next attempt does full handshake
+
+        this->report (log::level::note, 0x37, connection->peer);
+        try {
+            exclusive guard (this->lock);
+            this->connect_requests.emplace (connection->peer, connection->level);
+        } catch (const std::bad_alloc &) {
+            // reconnected later by regular peer selection
+        }
+        return;
+    }
     if (connection->level != blacklisted_nodes
             && connection->is_outbound ()
             && this->database.peers [connection->level]->adjust (connection->peer, -0xF) == 0) {
@@ -14,15 +14,20 @@
 #include "raddi_subscription_set.h"
 #include "raddi_request.h"
 #include "raddi_defaults.h"
+#include "raddi_timer_wheel.h"
 
 #include "raddi_detached.h"
 #include "raddi_noticed.h"
 
 #include <string>
 #include <random>
+#include <unordered_map>
 #include <list>
 #include <set>
 #include <map>
+#include <memory>
+#include <future>
+#include <atomic>
 
 namespace raddi {
     class connection;
@@ -64,9 +69,9 @@ namespace raddi {
         mutable std::uniform_int_distribution <std::size_t> random_distribution;
 
         // connect_requests
-        //  - addresses to try next, per user request, higher priority
+        //  - addresses to try next, per user request or after failed resumption, higher priority
         //
-        std::set <address> connect_requests;
+        std::map <address, level> connect_requests;
 
     public:
 
@@ -112,7 +117,7 @@ namespace raddi {
         raddi::noticed refused;
 
     private:
-        mutable lock lock;
+        mutable ::lock lock; // not biased, taken exclusively on every accept and sweep
 
         // pacing
         //  - last timestamp when coordinator evaluated status
@@ -122,6 +127,82 @@ namespace raddi {
         std::uint32_t last_peers_query = raddi::now ();
         std::size_t   previous_secured_count = 0;
 
+        // directory
+        //  - 'index' of 'connections' by peer IP address (port 0), modified only under exclusive 'lock'
+        //  - number of connections being attempted and connected, per level, maintained by 'tally'
+        //
+        struct {
+            ::lock                                          lock; // guards counters
+            std::unordered_multimap <address, connection *> index;
+            std::size_t attempting [levels] = {};
+            std::size_t connected [levels] = {};
+        } directory;
+
+        // postponed
+        //  - connections with entries held back by 'broadcast', or with receiving suspended
+        //    by 'throttle', see 'dispatch'
+        //  - 'timer' is armed to the nearest deadline in the 'wheel'
+        //
+        struct {
+            ::lock          lock;
+            HANDLE          timer = NULL;
+            std::uint64_t   armed = 0; // deadline the timer is armed to, 0 if not armed
+            timer_wheel <connection *, 64, 16'000> wheel; // 16ms resolution, ~1s span
+        } postponed;
+
+        // deadlines
+        //  - connections scheduled by their next keep-alive or timeout deadline, see 'keepalive'
+        //  - every connection is present exactly once, from 'track' until expired while retired
+        //  - retired connections are not removed, sweep waits until they expire, see 'connection::scheduled'
+        //  - 100ms resolution, levels span 6.4s, 6.8min, 7.3h and 19.4 days
+        //
+        struct {
+            ::lock lock;
+            timer_wheel <connection *, 64, 100'000, 4> wheel;
+        } deadlines;
+
+        // tickets
+        //  - resumption tickets received from peers we connected to, by peer address
+        //  - every ticket is single-use, see 'resumable', expired are dropped when full
+        //
+        struct resumable {
+            protocol::ticket ticket;
+            std::uint8_t     secret [protocol::resumption::secret_size];
+            std::uint32_t    received;
+
+            ~resumable () { sodium_memzero (this->secret, sizeof this->secret); }
+        };
+        struct {
+            ::lock                                  lock;
+            std::unordered_map <address, resumable> map;
+        } tickets;
+
+        // downloads
+        //  - short-lived cache of IDs of entries matching recent downloads of channel or thread,
+        //    so that many peers requesting the same download are served by a single table scan
+        //  - keyed by parent and threshold, expires after 'download_cache_lifetime' seconds,
+        //    dropped when new entry is inserted under the parent, see 'inserted'
+        //  - scan in progress is registered as 'pending' first, cursors of identical requests
+        //    wait for its result without blocking, see 'stream'
+        //  - 'size' is total number of IDs held, bounded by 'download_cache_limit'
+        //  - 'empty' is relaxed hint for 'inserted' to skip the lock when nothing is cached
+        //
+        struct cached_download {
+            std::shared_ptr <const std::vector <eid>>                           ids;
+            std::shared_future <std::shared_ptr <const std::vector <eid>>>     pending;
+            std::uint32_t                                                       latest; // timestamp the scan covers until
+            std::uint64_t                                                       scan = 0;
+
+            std::size_t size () const { return this->ids ? this->ids->size () : 0; }
+        };
+        struct {
+            ::lock                                                      lock;
+            std::map <std::pair <eid, std::uint32_t>, cached_download>  map;
+            std::size_t                                                 size = 0;
+            std::uint64_t                                               scans = 0;
+            std::atomic <bool>                                          empty { true };
+        } downloads;
+
         // connect_one_more_announced_node
         //  - when node announcement is received, this bumps the enthusiasm to validate it
         //  - intentionally 'bool' to coalesce multiple announcements
@@ -138,13 +219,53 @@ namespace raddi {
         std::uint32_t core_sync_threshold = 0;
 
         // core_sync_count
-        //  - how many other core nodes to ask for full database download
-        //    to make sure we really have everything
-        //  - TODO: reset when last core node disconnects
+        //  - into how many partitions to split the full database download,
+        //    each is downloaded from different core node in parallel
         //  - TODO: defaults.h, also read from options?
         // 
         std::uint32_t core_sync_count = 3;
 
+        // synchronization
+        //  - partitions of core sync range, from 'core_sync_threshold' until first core node connected,
+        //    being downloaded, see 'synchronize'
+        //  - partition whose source disconnects, makes no progress until 'deadline' (see 'partition_timeout'),
+        //    or that completes with fewer entries than the source reported (tally), is requested again
+        //    from another core node, at most 'attempts' times
+        //  - core nodes that don't announce 'partitioning' are asked for plain 'download' instead,
+        //    at most 'max_downloads' of them
+        //
+        struct partition {
+            std::uint32_t      oldest;
+            std::uint32_t      latest;
+            eid                position; // last entry received, to continue after
+            std::uint32_t      expected; // number of entries the source reported, 0 if unknown
+            std::uint32_t      deadline; // source must report progress until then
+            const connection * source; // null if not assigned
+            address            excluded; // source that delivered inconsistent data or stalled
+            std::uint8_t       attempts;
+            bool               complete;
+
+            static constexpr std::uint8_t max_attempts = 4;
+            static constexpr std::uint8_t max_downloads = 3;
+        };
+        struct {
+            ::lock                  lock;
+            std::vector <partition> partitions;
+            std::vector <const connection *> stalled; // sources that missed a deadline, not given another partition
+            std::uint32_t           downloads = 0; // plain downloads requested in place of partitions
+
+            // snapshot
+            //  - with 'snapshot_synchronization' the first core node is asked for manifest of its shards,
+            //    'covered' is the timestamp up to which the manifests were received
+            //  - manifests must keep arriving until 'deadline' (see 'partition_timeout'), otherwise
+            //    the rest of the range is partitioned by time
+            //
+            const connection *      snapshot = nullptr; // core node the manifest is being received from
+            std::uint32_t           deadline = 0;
+            std::uint32_t           covered = 0;
+            bool                    requested = false;
+        } synchronization;
+
     public:
 
         // settings
@@ -161,18 +282,30 @@ namespace raddi {
             bool local_peers_only = false;
             bool network_propagation_participation = true;
             bool channels_synchronization_participation = true;
+            bool channels_reconciliation = true; // see request::reconciliation
             bool full_database_downloads_allowed = false;
+            bool snapshots_allowed = false; // serving manifests of immutable shards, partitions are then not limited
+            bool snapshot_synchronization = false; // core sync starts by comparing manifest of core node's shards
 
             unsigned int keep_alive_period = raddi::defaults::connection_keep_alive_timeout;
 
             unsigned int announcement_sample_size = 40;
-            unsigned int max_requests_per_minute = 4096; // 0 means unlimited
+            unsigned int max_requests_per_minute = 65536; // weighted by request_limiter::cost, 0 means unlimited
             unsigned int max_allowed_rejected_entries = 16;
             unsigned int max_allowed_unsolicited_entries = 64;
             unsigned int max_individual_subscriptions = 65536; // also streams limit
             unsigned int local_peer_discovery_period = 1200;
             unsigned int more_peers_query_delay = 180;
             unsigned int full_database_download_limit = 62 * 86400;
+            unsigned int partition_timeout = 90; // seconds without progress after which core sync partition is reassigned
+            unsigned int download_chunk_size = 256 * 1024; // bytes streamed per download continuation, 0 streams whole download at once
+            unsigned int max_concurrent_downloads = 32; // per connection, further download requests are denied
+            unsigned int download_cache_lifetime = 15; // seconds, 0 disables caching of channel/thread downloads
+            unsigned int download_cache_limit = 1024 * 1024; // total IDs cached, single download up to 1/16 of this
+            unsigned int broadcast_delay = 1000; // ms, maximal random delay of entries originating here, 0 disables
+            unsigned int relayed_broadcast_delay = 250; // ms, maximal random delay of relayed entries, 0 disables
+            unsigned int receive_credit = 4 * 1024 * 1024; // bytes per second of entries each connection may feed in, 0 disables
+            unsigned int receive_latency_target = 1000; // us per entry, higher pipeline latency reduces the credit proportionally
         } settings;
 
     public:
@@ -210,9 +343,16 @@ namespace raddi {
         //  - for various reasons the peers disagreed on valid communication protocol
         //    and it would be detrimental to continue; although we are allowing a few
         //    honest errors to happen before banning the peer
+        //  - failed session resumption isn't penalized, peer is reconnected with full handshake
         //
         void disagreed (const connection * peer);
 
+        // tally
+        //  - connection changed its state (connected, secured, level), adjusts 'directory' counters
+        //  - 'retiring' is set when connection is about to be retired
+        //
+        void tally (connection * peer, bool retiring = false);
+
     public:
 
         // reflecting
@@ -232,7 +372,7 @@ namespace raddi {
         bool broadcasting () const;
 
         // active
-        //  - returns total number of secured connections into the network
+        //  - returns total number of secured connections into the network, O(1)
         //  - if 'attempting' or 'connected' is not null, reports number of connections
         //    of particular levels, being connection attempts or already connected ones
         //
@@ -304,8 +444,51 @@ namespace raddi {
         // broadcast
         //  - broadcasts the entry to all connections that are subscribed to the channel/thread/stream
         //    or everything (typically all, except leaf nodes)
+        //  - one randomly chosen connection receives the entry immediately, others after short random
+        //    delay (shorter for 'relayed' entries), to make origin analysis harder
         //
-        std::size_t broadcast (const db::root &, const entry * data, std::size_t size);
+        std::size_t broadcast (const db::root &, const entry * data, std::size_t size, bool relayed);
+
+        // inserted
+        //  - new entry was inserted into database under 'top' channel and thread,
+        //    invalidates cached downloads of those
+        //
+        void inserted (const db::root & top);
+
+        // throttle
+        //  - replenishes connection's receive credit and accounts entries it processed
+        //  - the credit rate is 'receive_credit' reduced when average processing time
+        //    of an entry exceeds 'receive_latency_target', i.e. disk or validation lags
+        //  - returns microseconds for which the connection should stop receiving, or 0
+        //
+        std::uint64_t throttle (connection *);
+
+        // suspend
+        //  - schedules connection, that stopped receiving, to 'resume' after 'delay' microseconds
+        //
+        bool suspend (connection *, std::uint64_t delay);
+
+        // resumable
+        //  - retrieves (and forgets) resumption ticket and its secret previously received from peer at 'address'
+        //  - returns false if there is no unexpired ticket for the address
+        //
+        bool resumable (const address &, protocol::ticket *, std::uint8_t * secret);
+
+        // dispatch
+        //  - transmits entries delayed by 'broadcast' above whose time has come
+        //    and resumes receiving on connections suspended by 'throttle'
+        //  - called when 'dispatcher' timer signals
+        //
+        void dispatch ();
+
+        // dispatcher
+        //  - sets waitable timer the coordinator arms when 'dispatch' needs to be called
+        //  - without the timer, the broadcast delay is not applied
+        //
+        void dispatcher (HANDLE timer) {
+            exclusive guard (this->postponed.lock);
+            this->postponed.timer = timer;
+        }
 
         // broadcast
         //  - sends request to all connections (optionally with additional data)
@@ -316,7 +499,8 @@ namespace raddi {
         }
 
         // keepalive
-        //  - transmit keep-alive packet to eligible/idle connections
+        //  - transmit keep-alive packet to eligible/idle connections and cancels timed out ones
+        //  - processes only connections whose deadline has passed, see 'deadlines'
         //  - returns time delay (us) for which it's not neccessary to call this function
         //
         std::uint64_t keepalive ();
@@ -326,7 +510,7 @@ namespace raddi {
         //
         void connect (const address & a) {
             exclusive guard (this->lock);
-            this->connect_requests.insert (a);
+            this->connect_requests.emplace (a, announced_nodes);
         }
 
         // subscribe/unsubscribe
@@ -356,15 +540,48 @@ namespace raddi {
         void announce (const address &, bool, connection *);
         void announce_random_peers (connection *);
         void set_discovery_spread ();
-        void process_download_request (const request::download *, connection *);
+        void track (connection *);
+        void untrack (connection *);
+        bool inuse (const address &, bool retired) const;
+        bool postpone (connection *, std::uint64_t now, std::uint64_t delay);
+        void arm (std::uint64_t now, std::uint64_t deadline);
+        bool process_download_request (const request::download *, connection *, const eid * position = nullptr,
+                                       std::uint32_t latest = 0, bool unlimited = false);
+        void stream (connection *);
+        std::shared_ptr <const std::vector <eid>> scan_download (const eid & parent, std::uint32_t threshold, std::uint32_t * latest,
+                                                                 std::shared_future <std::shared_ptr <const std::vector <eid>>> * pending);
+        bool synchronize (connection *);
+        bool schedule_partition (std::uint32_t oldest, std::uint32_t latest, std::uint32_t expected);
+        bool is_core (const connection *) const;
+        void supervise_synchronization (std::uint32_t now);
+        void process_snapshot_request (std::uint32_t oldest, connection *);
+        void process_manifest (const request::manifest *, std::size_t size, connection *);
+        void synchronized (connection *, const request::continuation *);
         
         template <typename Key>
         void report_table_history (connection *, enum class request::type, db::table <Key> *) const;
         template <enum class request::type RT, typename Key>
         bool process_table_history (const raddi::request::history * history, std::size_t size, connection *, db::table <Key> *);
+        template <enum class request::type RT, typename Key>
+        bool process_table_reconciliation (const raddi::request::reconciliation *, std::size_t size, connection *, db::table <Key> *);
+        template <enum class request::type RT, typename Key>
+        bool reconcile (connection *, db::table <Key> *, std::uint32_t oldest, std::uint32_t latest,
+                        std::uint8_t round, std::uint8_t flags = 0x00, std::size_t parts = request::reconciliation::max_parts) const;
+        template <typename Key>
+        void digest_table_range (const request::reconciliation *, std::size_t n, db::table <Key> *,
+                                 std::uint64_t * digests, std::size_t * numbers) const;
+        template <typename Key>
+        void digest_table_ranges (const std::pair <std::uint32_t, std::uint32_t> * ranges, std::size_t n, db::table <Key> *,
+                                  std::uint64_t * digests, std::size_t * numbers) const;
 
-        std::size_t gather_history (const eid &, request::subscription *) const;
+        std::size_t gather_history (const eid &, request::subscription *, std::size_t depth = request::subscription::depth) const;
+        std::size_t gather_breakdown (const eid &, std::uint32_t oldest, std::uint32_t latest, request::breakdown *) const;
         bool process_history (const raddi::request::subscription * history, std::size_t size, connection *);
+        void gather_subscriptions (connection *);
+        void process_subscriptions (connection *);
+        void process_breakdown (const raddi::request::breakdown * breakdown, std::size_t size, connection *);
+        bool process_history_spans (const eid &, const std::map <std::pair <std::uint32_t, std::uint32_t>, std::uint32_t> &,
+                                    bool elaborate, std::pair <std::uint32_t, std::uint32_t> range, connection *);
 
         bool move (const address &, level, std::uint16_t = db::peerset::new_record_assessment, bool adjust = true);
         bool move (connection *, level, std::uint16_t = db::peerset::new_record_assessment);
@@ -15,8 +15,14 @@ void raddi::db::peerset::load (const std::wstring & path, int family, int level)
         std::size_t n = 0;
 
         a.family = family;
+        exclusive guard (this->lock);
         while (f.read (a.data (), address::size (family)) && f.read (&s, sizeof s)) {
-            this->addresses [a] = s;
+            auto i = this->index.find (a);
+            if (i != this->index.end ()) {
+                this->addresses [i->second].second = s;
+            } else {
+                this->unsynchronized_insert (a, s);
+            }
             ++n;
         }
 
@@ -61,31 +67,25 @@ void raddi::db::peerset::save () const {
 }
 
 std::uint32_t raddi::db::peerset::adjust (const address & a, std::int16_t adj) {
-    immutability guard (this->lock);
-    auto i = this->addresses.find (a);
-    if (i != this->addresses.end ()) {
+    exclusive guard (this->lock);
+    auto i = this->index.find (a);
+    if (i != this->index.end ()) {
+        auto & assessment = this->addresses [i->second].second;
         if (adj) {
-            auto updated = (int) i->second + (int) adj;
+            auto updated = (int) assessment + (int) adj;
 
             if (updated < 0)
                 updated = 0;
             if (updated > 0xFF)
                 updated = 0xFF;
 
-            i->second = (std::uint16_t) updated;
+            assessment = (std::uint16_t) updated;
 
             if (a.accessible (address::validation::allow_null_port)) {
-                switch (a.family) {
-                    case AF_INET:
-                        this->ipv4changed = true;
-                        break;
-                    case AF_INET6:
-                        this->ipv6changed = true;
-                        break;
-                }
+                this->unsynchronized_changed (a);
             }
         }
-        return i->second;
+        return assessment;
     } else
         return 0;
 }
@@ -95,12 +95,11 @@ raddi::db::peerset::select (std::size_t random_value, std::uint16_t * assessment
     immutability guard (this->lock);
     auto size = this->addresses.size ();
     if (size) {
-        auto i = this->addresses.begin ();
-        std::advance (i, random_value % size);
+        const auto & record = this->addresses [random_value % size];
         if (assessment) {
-            *assessment = i->second;
+            *assessment = record.second;
         }
-        return i->first;
+        return record.first;
     } else {
         // assert (false);
         return address ();
@@ -110,12 +109,10 @@ raddi::db::peerset::select (std::size_t random_value, std::uint16_t * assessment
 void raddi::db::peerset::prune (std::uint16_t threshold) {
     exclusive guard (this->lock);
 
-    auto i = this->addresses.begin ();
-    auto e = this->addresses.end ();
-    while (i != e) {
-        if (threshold >= i->second) {
-            i = this->addresses.erase (i);
-            e = this->addresses.end ();
+    std::size_t i = 0;
+    while (i != this->addresses.size ()) {
+        if (threshold >= this->addresses [i].second) {
+            this->unsynchronized_erase (i); // moves last record into 'i'
         } else
             ++i;
     }
@@ -127,67 +124,100 @@ bool raddi::db::peerset::empty () const {
 }
 bool raddi::db::peerset::count (const raddi::address & a) const {
     immutability guard (this->lock);
-    return this->addresses.count (a);
+    return this->index.count (a);
 }
 bool raddi::db::peerset::count_ip (const raddi::address & a) const {
-    auto lower = a;
-    auto upper = a;
-
-    lower.port = 0;
-    upper.port = 65535;
+    auto ip = a;
+    ip.port = 0;
 
     immutability guard (this->lock);
-    auto i = this->addresses.lower_bound (lower);
-    return i != this->addresses.end ()
-        && i->first <= upper;
+    return this->ips.count (ip);
 }
 
 void raddi::db::peerset::erase (const address & a) {
     exclusive guard (this->lock);
     if (a.port == 0) {
-        auto lower = a;
-        auto upper = a;
-
-        lower.port = 0;
-        upper.port = 65535;
-
-        while (true) {
-            auto i = this->addresses.lower_bound (lower);
-            if (i != this->addresses.end () && i->first <= upper) {
-                this->addresses.erase (i);
-                switch (a.family) {
-                    case AF_INET:
-                        this->ipv4changed = true;
-                        break;
-                    case AF_INET6:
-                        this->ipv6changed = true;
-                        break;
-                }
-            } else
-                return;
+
+        // erasing all records of the IP address
+        //  - linear, but only done when banning, and only when the IP is present at all
+
+        if (this->ips.count (a)) {
+            std::size_t i = 0;
+            while (i != this->addresses.size ()) {
+                auto ip = this->addresses [i].first;
+                ip.port = 0;
+
+                if (ip == a) {
+                    this->unsynchronized_erase (i);
+                    this->unsynchronized_changed (a);
+                } else
+                    ++i;
+            }
         }
     } else {
-        this->addresses.erase (a);
-        switch (a.family) {
-            case AF_INET:
-                this->ipv4changed = true;
-                break;
-            case AF_INET6:
-                this->ipv6changed = true;
-                break;
+        auto i = this->index.find (a);
+        if (i != this->index.end ()) {
+            this->unsynchronized_erase (i->second);
         }
+        this->unsynchronized_changed (a);
     }
 }
 void raddi::db::peerset::insert (const address & a, std::uint16_t s) {
     exclusive guard (this->lock);
-    if (this->addresses.emplace (a, s).second && a.accessible (address::validation::allow_null_port)) {
-        switch (a.family) {
-            case AF_INET:
-                this->ipv4changed = true;
-                break;
-            case AF_INET6:
-                this->ipv6changed = true;
-                break;
+    if (!this->index.count (a)) {
+        this->unsynchronized_insert (a, s);
+
+        if (a.accessible (address::validation::allow_null_port)) {
+            this->unsynchronized_changed (a);
         }
     }
 }
+
+void raddi::db::peerset::unsynchronized_insert (const address & a, std::uint16_t s) {
+    auto ip = a;
+    ip.port = 0;
+
+    this->addresses.emplace_back (a, s);
+    try {
+        this->index [a] = this->addresses.size () - 1;
+        ++this->ips [ip];
+    } catch (...) {
+        this->index.erase (a);
+        this->addresses.pop_back ();
+        throw;
+    }
+}
+
+void raddi::db::peerset::unsynchronized_erase (std::size_t i) {
+    auto ip = this->addresses [i].first;
+    ip.port = 0;
+
+    auto n = this->ips.find (ip);
+    if (n != this->ips.end ()) {
+        if (--n->second == 0) {
+            this->ips.erase (n);
+        }
+    }
+    this->index.erase (this->addresses [i].first);
+
+    // swap-remove
+    //  - last record is moved into the vacated position, and its index updated
+
+    auto last = this->addresses.size () - 1;
+    if (i != last) {
+        this->addresses [i] = this->addresses [last];
+        this->index [this->addresses [i].first] = i;
+    }
+    this->addresses.pop_back ();
+}
+
+void raddi::db::peerset::unsynchronized_changed (const address & a) const {
+    switch (a.family) {
+        case AF_INET:
+            this->ipv4changed = true;
+            break;
+        case AF_INET6:
+            this->ipv6changed = true;
+            break;
+    }
+}
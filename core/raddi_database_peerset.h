@@ -8,6 +8,8 @@
 #include "raddi_database.h"
 
 #include <map>
+#include <vector>
+#include <unordered_map>
 
 class raddi::db::peerset
     : log::provider <component::database> {
@@ -19,13 +21,24 @@ class raddi::db::peerset
     std::map <short, std::wstring> paths;
 
     // addresses
-    //  - 
+    //  - dense storage, unordered, so that random selection is O(1)
     //  - blacklisted inbound addresses have port number set to 0
     //  - std::uint16_t is assessment
     //     - generally value 0 - 255
     //     - for blacklisted nodes it's (timestamp / 86400) when the ban gets lifted
     //
-    std::map <address, std::uint16_t> addresses;
+    std::vector <std::pair <address, std::uint16_t>> addresses;
+
+    // index
+    //  - maps address to position in 'addresses' vector
+    //
+    std::unordered_map <address, std::size_t> index;
+
+    // ips
+    //  - number of records (ports) per IP address, the key has port set to 0
+    //  - for count_ip and erasing all ports of an IP address
+    //
+    std::unordered_map <address, std::size_t> ips;
 
 public:
     // new_record_assessment
@@ -51,6 +64,11 @@ public:
     bool empty () const;
     bool count (const address & a) const;
     bool count_ip (const address & a) const;
+
+private:
+    void unsynchronized_insert (const address &, std::uint16_t);
+    void unsynchronized_erase (std::size_t i);
+    void unsynchronized_changed (const address &) const;
 };
 
 #endif
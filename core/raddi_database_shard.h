@@ -25,6 +25,22 @@ class raddi::db::shard
     //
     std::vector <Key> cache;
 
+    // histogram
+    //  - number of rows per 'histogram_granularity' seconds since 'base', maintained on insert/erase
+    //    and kept when the shard is closed, so that 'count' doesn't need to load the cache
+    //  - saved (by writer) on 'flush' and 'close' into file with "h" suffix, prefixed by number
+    //    of rows in index file at that time, to detect stale histogram when loading it
+    //  - the file is removed on 'erase', which doesn't change number of rows
+    //  - 'valid' when loaded or rebuilt from cache, 'dirty' when changed since saved
+    //
+    struct {
+        std::vector <std::uint32_t> buckets;
+        bool valid = false;
+        bool dirty = false;
+    } histogram;
+
+    static constexpr std::uint32_t histogram_granularity = 300;
+
 public:
     shard (std::uint32_t base, const db::table <Key> * = nullptr);
     shard (shard &&);
@@ -32,8 +48,9 @@ public:
 
     // close
     //  - frees shard cache and closes file handles
+    //  - saves histogram, if 'table' is provided
     //
-    bool close ();
+    bool close (const db::table <Key> * = nullptr);
     bool closed () const { return this->index.closed (); }
 
     // advance
@@ -49,7 +66,7 @@ public:
     // flush
     //  - general flush of data and metadata so that db readers see the changes
     //
-    void flush ();
+    void flush (const db::table <Key> *);
 
     // insert
     //  - inserts whole entry (decoded protocol frame) into the shard, adding cached 'root' eids
@@ -85,6 +102,14 @@ public:
     //
     std::size_t size (const db::table <Key> *) const;
 
+    // count
+    //  - returns number of rows with timestamp between 'oldest' and 'latest' (inclusive)
+    //  - 'tail' - the range extends past the end of the shard (start of the next one)
+    //  - computed from cache if loaded, otherwise from histogram; the cache is loaded only
+    //    if the range doesn't align to histogram buckets or the histogram isn't available
+    //
+    std::size_t count (const db::table <Key> *, std::uint32_t oldest, std::uint32_t latest, bool tail);
+
     // top
     //  - retrieves key of latest (youngest) inserted entry (parameter)
     //  - returns false if shard is closed or empty
@@ -105,6 +130,12 @@ public:
     template <typename F>
     void enumerate (const db::table <Key> * table, F callback);
 
+    // enumerate
+    //  - enumerates only entries following 'after', found by binary search
+    //
+    template <typename F>
+    void enumerate (const db::table <Key> * table, const decltype (Key::id) & after, F callback);
+
 public:
     friend bool operator < (const shard & a, const shard & b) { return a.base < b.base; }
     friend bool operator < (const shard & a, const std::uint32_t & b) { return a.base < b; }
@@ -116,6 +147,15 @@ private:
     void unsynchronized_close ();
     bool unsynchronized_advance (const db::table <Key> *);
     void unsynchronized_insert_to_cache (const Key &);
+    void unsynchronized_account (std::uint32_t timestamp, bool inserted);
+    void unsynchronized_rebuild_histogram ();
+    bool unsynchronized_load_histogram (const db::table <Key> *);
+    void unsynchronized_save_histogram (const db::table <Key> *);
+    bool unsynchronized_count_histogram (std::uint32_t oldest, std::uint32_t latest, bool tail, std::size_t & n) const;
+    std::size_t unsynchronized_count (std::uint32_t oldest, std::uint32_t latest) const;
+
+    template <typename F>
+    void unsynchronized_enumerate (const db::table <Key> * table, typename std::vector <Key> ::const_iterator i, F callback);
 
     bool unsynchronized_get (const db::table <Key> *, const decltype (Key::id) &, Key * = nullptr,
                              read = read::nothing, void * = nullptr, std::size_t * = nullptr, std::size_t = 0u);
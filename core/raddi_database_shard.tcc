@@ -24,7 +24,8 @@ raddi::db::shard <Key>::shard (raddi::db::shard <Key> && other)
     , accessed (raddi::now ())
     , index (std::move (other.index))
     , content (std::move (other.content))
-    , cache (std::move (other.cache)) {}
+    , cache (std::move (other.cache))
+    , histogram (std::move (other.histogram)) {}
 
 template <typename Key>
 raddi::db::shard <Key> & raddi::db::shard <Key>::operator = (raddi::db::shard <Key> && other) {
@@ -37,6 +38,7 @@ raddi::db::shard <Key> & raddi::db::shard <Key>::operator = (raddi::db::shard <K
     this->index = std::move (other.index);
     this->content = std::move (other.content);
     this->cache.swap (other.cache);
+    this->histogram = std::move (other.histogram);
     return *this;
 }
 
@@ -48,9 +50,12 @@ void raddi::db::shard <Key>::unsynchronized_close () {
 }
 
 template <typename Key>
-bool raddi::db::shard <Key>::close () {
+bool raddi::db::shard <Key>::close (const db::table <Key> * table) {
     if (!this->closed ()) {
         exclusive guard (this->lock);
+        if (table) {
+            this->unsynchronized_save_histogram (table);
+        }
         this->unsynchronized_close ();
         this->cache.shrink_to_fit ();
         return true;
@@ -59,7 +64,11 @@ bool raddi::db::shard <Key>::close () {
 }
 
 template <typename Key>
-void raddi::db::shard <Key>::flush () {
+void raddi::db::shard <Key>::flush (const db::table <Key> * table) {
+    if (this->histogram.dirty) {
+        exclusive guard (this->lock);
+        this->unsynchronized_save_histogram (table);
+    }
     this->content.flush ();
     this->index.flush ();
 }
@@ -169,8 +178,12 @@ bool raddi::db::shard <Key>::unsynchronized_advance (const db::table <Key> * tab
         const auto size = this->index.size ();
         const auto n = size / sizeof (Key);
 
-        if (n == this->cache.size ())
+        if (n == this->cache.size ()) {
+            if (opened) {
+                this->unsynchronized_rebuild_histogram ();
+            }
             return true;
+        }
 
         if (n) {
 
@@ -204,6 +217,7 @@ bool raddi::db::shard <Key>::unsynchronized_advance (const db::table <Key> * tab
                                        std::find_if_not (this->cache.begin (), this->cache.end (),
                                                          [] (auto & x) { return x.id.erased (); }));
                 }
+                this->unsynchronized_rebuild_histogram ();
             } else {
                 this->cache.reserve (n);
 
@@ -232,6 +246,152 @@ void raddi::db::shard <Key>::unsynchronized_insert_to_cache (const Key & r) {
     } else {
         this->cache.insert (std::lower_bound (this->cache.begin (), this->cache.end (), r), r);
     }
+    this->unsynchronized_account (r.id.timestamp, true);
+}
+
+template <typename Key>
+void raddi::db::shard <Key>::unsynchronized_account (std::uint32_t timestamp, bool inserted) {
+    if (this->histogram.valid && (timestamp >= this->base)) {
+        const std::size_t i = (timestamp - this->base) / histogram_granularity;
+
+        if (i >= this->histogram.buckets.size ()) {
+            this->histogram.buckets.resize (i + 1);
+        }
+        if (inserted) {
+            ++this->histogram.buckets [i];
+        } else {
+            if (this->histogram.buckets [i]) {
+                --this->histogram.buckets [i];
+            }
+        }
+        this->histogram.dirty = true;
+    }
+}
+
+template <typename Key>
+void raddi::db::shard <Key>::unsynchronized_rebuild_histogram () {
+    this->histogram.buckets.clear ();
+    this->histogram.valid = true;
+
+    for (const auto & row : this->cache) {
+        this->unsynchronized_account (row.id.timestamp, true);
+    }
+    this->histogram.dirty = true;
+}
+
+template <typename Key>
+bool raddi::db::shard <Key>::unsynchronized_load_histogram (const db::table <Key> * table) {
+    file f;
+    file i;
+    if (f.open (this->path (table, L"h"), file::mode::open, file::access::read, file::share::full, file::buffer::sequential)
+            && i.open (this->path (table), file::mode::open, file::access::query, file::share::full, file::buffer::none)) {
+
+        // histogram is stale if rows were added since it was saved
+
+        const auto size = f.size ();
+        std::uint32_t rows;
+
+        if ((size >= sizeof rows) && ((size - sizeof rows) % sizeof (std::uint32_t) == 0)
+                && f.read (rows) && (rows == i.size () / sizeof (Key))) {
+            try {
+                this->histogram.buckets.resize ((std::size_t) (size - sizeof rows) / sizeof (std::uint32_t));
+
+                if (this->histogram.buckets.empty ()
+                        || f.read (&this->histogram.buckets [0], this->histogram.buckets.size () * sizeof (std::uint32_t))) {
+
+                    this->histogram.valid = true;
+                    this->histogram.dirty = false;
+                    return true;
+                }
+            } catch (const std::bad_alloc &) {
+                // loading cache instead
+            }
+            this->histogram.buckets.clear ();
+        }
+    }
+    return false;
+}
+
+template <typename Key>
+void raddi::db::shard <Key>::unsynchronized_save_histogram (const db::table <Key> * table) {
+    if (this->histogram.valid && this->histogram.dirty && !this->index.closed () && (table->db.mode == file::access::write)) {
+        const auto rows = std::uint32_t (this->index.size () / sizeof (Key));
+
+        file f;
+        if (f.open (this->path (table, L"h"), file::mode::always, file::access::write, file::share::full)
+                && f.write (rows)
+                && (this->histogram.buckets.empty ()
+                    || f.write (&this->histogram.buckets [0], this->histogram.buckets.size () * sizeof (std::uint32_t)))
+                && f.resize (f.tell ())) {
+
+            this->histogram.dirty = false;
+        } else {
+            this->report (log::level::error, 26, this->path (table, L"h"));
+        }
+    }
+}
+
+template <typename Key>
+bool raddi::db::shard <Key>::unsynchronized_count_histogram (std::uint32_t oldest, std::uint32_t latest, bool tail, std::size_t & n) const {
+    n = 0;
+    if ((latest < oldest) || (latest < this->base))
+        return true;
+
+    const auto first = (oldest - this->base) / histogram_granularity;
+    const auto last = (latest - this->base) / histogram_granularity;
+
+    // range needs to start and end at buckets boundary, unless it ends past all buckets
+
+    if ((oldest - this->base) % histogram_granularity)
+        return false;
+
+    if (!tail && (last < this->histogram.buckets.size ())
+              && ((latest - this->base) % histogram_granularity != histogram_granularity - 1))
+        return false;
+
+    for (auto i = first; (i < this->histogram.buckets.size ()) && (i <= last); ++i) {
+        n += this->histogram.buckets [i];
+    }
+    return true;
+}
+
+template <typename Key>
+std::size_t raddi::db::shard <Key>::unsynchronized_count (std::uint32_t oldest, std::uint32_t latest) const {
+    if (latest < oldest)
+        return 0;
+
+    auto lo = std::lower_bound (this->cache.begin (), this->cache.end (), oldest,
+                                [] (const Key & row, std::uint32_t t) { return row.id.timestamp < t; });
+    auto hi = std::upper_bound (lo, this->cache.end (), latest,
+                                [] (std::uint32_t t, const Key & row) { return t < row.id.timestamp; });
+    return hi - lo;
+}
+
+template <typename Key>
+std::size_t raddi::db::shard <Key>::count (const db::table <Key> * table, std::uint32_t oldest, std::uint32_t latest, bool tail) {
+    if (oldest < this->base) {
+        oldest = this->base;
+    }
+
+    std::size_t n;
+    {
+        immutability guard (this->lock);
+        if (!this->index.closed ())
+            return this->unsynchronized_count (oldest, latest);
+
+        if (this->histogram.valid && this->unsynchronized_count_histogram (oldest, latest, tail, n))
+            return n;
+    }
+
+    exclusive guard (this->lock);
+    if (this->index.closed () && !this->histogram.valid) {
+        if (this->unsynchronized_load_histogram (table) && this->unsynchronized_count_histogram (oldest, latest, tail, n))
+            return n;
+    }
+    if (this->unsynchronized_advance (table))
+        return this->unsynchronized_count (oldest, latest);
+    else
+        return 0;
 }
 
 template <typename Key>
@@ -360,6 +520,13 @@ bool raddi::db::shard <Key>::erase (const db::table <Key> * table, const decltyp
                 offset += sizeof (Key);
             }
 
+            // erasing doesn't change number of rows in index file, so the saved histogram
+            // would pass as current; remove it until saved again (it's dirty from now on)
+
+            if (this->histogram.valid && !this->histogram.dirty) {
+                file::unlink (this->path (table, L"h"));
+            }
+            this->unsynchronized_account (ii->id.timestamp, false);
             this->cache.erase (ii);
             return true;
         }
@@ -477,8 +644,8 @@ raddi::db::shard <Key> raddi::db::shard <Key>::split (const db::table <Key> * ta
     const auto tmp_content_filename = this->path (table, suffix.c_str () + 0);
 
     if (this->unsynchronized_advance (table)
-        && MoveFileEx (this->path (table).c_str (), tmp_index_filename.c_str (), MOVEFILE_REPLACE_EXISTING)
-        && MoveFileEx (this->path (table, L"d").c_str (), tmp_content_filename.c_str (), MOVEFILE_REPLACE_EXISTING)) {
+        && file::rename (this->path (table), tmp_index_filename)
+        && file::rename (this->path (table, L"d"), tmp_content_filename)) {
 
         // TODO: this and remaining probably use the same data file
 
@@ -519,8 +686,8 @@ raddi::db::shard <Key> raddi::db::shard <Key>::split (const db::table <Key> * ta
 
         // assert (this->cache.size () == n2);
 
-        DeleteFile (tmp_index_filename.c_str ());
-        DeleteFile (tmp_content_filename.c_str ());
+        file::unlink (tmp_index_filename);
+        file::unlink (tmp_content_filename);
 
         return std::move (separated);
     } else {
@@ -533,8 +700,19 @@ template <typename Key>
     template <typename F>
 void raddi::db::shard <Key> ::enumerate (const db::table <Key> * table, F callback) {
     immutability guard (this->lock);
+    this->unsynchronized_enumerate (table, this->cache.cbegin (), callback);
+}
 
-    auto i = this->cache.cbegin ();
+template <typename Key>
+    template <typename F>
+void raddi::db::shard <Key> ::enumerate (const db::table <Key> * table, const decltype (Key::id) & after, F callback) {
+    immutability guard (this->lock);
+    this->unsynchronized_enumerate (table, std::upper_bound (this->cache.cbegin (), this->cache.cend (), Key { after }), callback);
+}
+
+template <typename Key>
+    template <typename F>
+void raddi::db::shard <Key> ::unsynchronized_enumerate (const db::table <Key> * table, typename std::vector <Key> ::const_iterator i, F callback) {
     auto e = this->cache.cend ();
 
     for (; i != e; ++i) {
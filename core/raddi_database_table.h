@@ -17,7 +17,7 @@ class raddi::db::table
     : public Monitor <raddi::component::database>
     , virtual log::provider <component::database> {
 
-    mutable ::lock                   lock;   // protects shards
+    mutable ::biased_lock            lock;   // protects shards
     mutable std::vector <shard <Key>> shards; // sorted vector
 
     mutable ::lock                   advance_lock;
@@ -151,15 +151,21 @@ public:
                              callback);
     }
 
+    // select_after
+    //  - same as 'select' but for entries following 'position' up to 'latest' (inclusive)
+    //  - starts at shard containing 'position' and binary-searches within it, so that
+    //    chunked enumeration (continued downloads) doesn't rescan all older shards
+    //  - 'index' of unnamed structure is relative to 'position' in its shard
+    //
+    template <typename T, typename U, typename V>
+    std::size_t select_after (const decltype (Key::id) & position, std::uint32_t latest,
+                              T constrain, U query, V callback) const;
+
     // count
-    //  - calls select to count number of entries within the range
+    //  - returns number of entries within the range (inclusive)
+    //  - uses shard histograms where possible, see 'shard::count'
     //
-    std::size_t count (std::uint32_t oldest, std::uint32_t latest) {
-        return this->select (oldest, latest,
-                             [] (const Key &, const auto & detail) { return true; },
-                             [] (const Key &, const auto & detail) { return false; },
-                             [] (const Key &, const auto & detail, std::uint8_t *) {});
-    }
+    std::size_t count (std::uint32_t oldest, std::uint32_t latest) const;
 
     // TODO: queries that will be needed later
     //  - select all in thread
@@ -49,7 +49,7 @@ void raddi::db::table <Key>::flush () {
     immutability guard (this->lock);
     for (auto & shard : this->shards) {
         if (!shard.closed ()) {
-            shard.flush ();
+            shard.flush (this);
         }
     }
 }
@@ -227,6 +227,33 @@ raddi::db::shard <Key> * raddi::db::table <Key>::unsynchronized_find_shard (std:
     return &*i;
 }
 
+template <typename Key>
+std::size_t raddi::db::table <Key>::count (std::uint32_t oldest, std::uint32_t latest) const {
+    std::size_t n = 0;
+
+    immutability guard (this->lock);
+    for (auto i = this->shards.begin (), e = this->shards.end (); i != e; ++i) {
+
+        if (raddi::older (latest, i->base)) { // i->base > latest
+            break; // we are done
+        }
+
+        // skip shards entirely preceding the range, their 'tail' is the next shard's base
+
+        const auto next = i + 1;
+        const auto tail = (next != e) && !raddi::older (latest, next->base);
+
+        if ((next != e) && !raddi::older (oldest, next->base))
+            continue;
+
+        if (!i->closed () && this->need_shard_to_advance (&*i)) {
+            i->advance (this);
+        }
+        n += i->count (this, oldest, latest, tail);
+    }
+    return n;
+}
+
 template <typename Key>
 std::size_t raddi::db::table <Key>::optimize (std::uint32_t threshold) {
     immutability guard (this->lock);
@@ -234,7 +261,7 @@ std::size_t raddi::db::table <Key>::optimize (std::uint32_t threshold) {
     std::size_t n = 0;
     for (auto & s : this->shards) {
         if (raddi::older (s.accessed, threshold)) {
-            n += s.close ();
+            n += s.close (this);
         }
     }
     return n;
@@ -266,7 +293,7 @@ std::size_t raddi::db::table <Key>::prune (std::size_t keep) {
 
     std::size_t n = 0;
     for (std::size_t i = 0; i != tops; ++i) {
-        n += index [i].second->close ();
+        n += index [i].second->close (this);
     }
     return n;
 }
@@ -365,4 +392,62 @@ std::size_t raddi::db::table <Key>::select (std::uint32_t oldest, std::uint32_t
     return info.match;
 }
 
+template <typename Key>
+    template <typename T, typename U, typename V>
+std::size_t raddi::db::table <Key>::select_after (const decltype (Key::id) & position, std::uint32_t latest, T constrain, U query, V callback) const {
+    struct {
+        std::uint32_t shard;
+        std::uint32_t index; // row index in current shard, relative to 'position'
+        std::size_t   count; // row count in current shard
+
+        std::size_t   total = 0; // total evaluated entries in shards
+        std::size_t   match = 0; // total rows matching timestamp range and constrain
+    } info;
+
+    const auto oldest = position.timestamp;
+
+    immutability guard (this->lock);
+
+    // start with shard that could contain 'position', see 'unsynchronized_find_shard'
+
+    auto i = std::upper_bound (this->shards.begin (), this->shards.end (), oldest);
+    if (i != this->shards.begin ()) {
+        --i;
+    }
+
+    for (auto e = this->shards.end (); i != e; ++i) {
+
+        if (raddi::older (latest, i->base)) { // i->base > latest
+            break; // we are done
+        }
+        if (this->need_shard_to_advance (&*i)) {
+            i->advance (this);
+        }
+
+        info.shard = i->base;
+        info.index = 0;
+        info.count = i->size (this);
+
+        i->enumerate (this, position, [&info, oldest, latest, constrain, query, callback] (const Key & row, std::uint8_t * data) -> bool {
+            bool r = false;
+            if (data) {
+                callback (row, info, data);
+                return false;
+
+            } else {
+                if (!raddi::older (row.id.timestamp, oldest) && raddi::older (row.id.timestamp, latest + 1)) {
+                    if (constrain (row, info)) {
+                        ++info.match;
+                        r = query (row, info);
+                    }
+                }
+                ++info.index;
+                ++info.total;
+                return r;
+            }
+        });
+    }
+    return info.match;
+}
+
 #endif
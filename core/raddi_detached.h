@@ -28,7 +28,7 @@ namespace raddi {
     public:
         counter inserted;
         counter rejected; // only actively rejected, data dropped by 'clean' = 'inserted' - 'processed' - 'rejected'
-        counter processed;
+        sharded_counter processed;
         counter highwater;
         std::uint32_t highwater_time = 0;
 
@@ -1,8 +1,105 @@
 #include "raddi_protocol.h"
 #include "raddi_timestamp.h"
+#include "../common/lock.h"
+#include <atomic>
+#include <set>
 
 alignas (std::uint64_t) char raddi::protocol::magic [8] = "RADDI/1";
 enum raddi::protocol::aes256gcm_mode raddi::protocol::aes256gcm_mode = raddi::protocol::aes256gcm_mode::automatic;
+std::uint32_t raddi::protocol::resumption::lifetime = 3600;
+
+namespace {
+
+    // issuer
+    //  - ticket key and record of redeemed tickets, initialized on first use (after sodium_init)
+    //
+    struct issuer {
+        std::uint8_t                key [crypto_aead_xchacha20poly1305_ietf_KEYBYTES];
+        std::atomic <std::uint32_t> serial { 0 };
+        ::lock                      lock;
+        std::set <std::uint64_t>    redeemed; // timestamp << 32 | serial
+
+        issuer () {
+            randombytes_buf (this->key, sizeof this->key);
+        }
+        ~issuer () {
+            sodium_memzero (this->key, sizeof this->key);
+        }
+
+        static void nonce (std::uint8_t (&nonce) [crypto_aead_xchacha20poly1305_ietf_NPUBBYTES], const raddi::protocol::ticket * t) {
+            std::memset (nonce, 0, sizeof nonce);
+            std::memcpy (&nonce [0], &t->timestamp, sizeof t->timestamp);
+            std::memcpy (&nonce [4], &t->serial, sizeof t->serial);
+        }
+    };
+
+    issuer & tickets () {
+        static issuer instance;
+        return instance;
+    }
+
+    // derive
+    //  - derives session key for one direction from resumption 'secret' and both peer's nonces
+    //
+    void derive (std::uint8_t * key, const std::uint8_t * secret, const std::uint8_t * nonce1, const std::uint8_t * nonce2, std::size_t nonce_size) {
+        crypto_generichash_state state;
+        crypto_generichash_init (&state, secret, raddi::protocol::resumption::secret_size, crypto_generichash_BYTES);
+        crypto_generichash_update (&state, nonce1, nonce_size);
+        crypto_generichash_update (&state, nonce2, nonce_size);
+        crypto_generichash_update (&state, reinterpret_cast <const unsigned char *> (raddi::protocol::magic), sizeof raddi::protocol::magic);
+        crypto_generichash_final (&state, key, crypto_generichash_BYTES);
+        sodium_memzero (&state, sizeof state);
+    }
+}
+
+bool raddi::protocol::resumption::issue (const std::uint8_t * secret, ticket * t) {
+    if (lifetime) {
+        auto & issuer = tickets ();
+
+        t->timestamp = raddi::now ();
+        t->serial = issuer.serial++;
+
+        std::uint8_t nonce [crypto_aead_xchacha20poly1305_ietf_NPUBBYTES];
+        issuer::nonce (nonce, t);
+
+        return crypto_aead_xchacha20poly1305_ietf_encrypt_detached (t->secret, t->mac, nullptr, secret, secret_size,
+                                                                    nullptr, 0, nullptr, nonce, issuer.key) == 0;
+    } else
+        return false;
+}
+
+bool raddi::protocol::resumption::redeem (const ticket * t, std::uint8_t * secret) {
+    if (lifetime) {
+        const auto now = raddi::now ();
+        if (raddi::older (t->timestamp + lifetime, now) || raddi::older (now, t->timestamp))
+            return false;
+
+        auto & issuer = tickets ();
+
+        std::uint8_t nonce [crypto_aead_xchacha20poly1305_ietf_NPUBBYTES];
+        issuer::nonce (nonce, t);
+
+        if (crypto_aead_xchacha20poly1305_ietf_decrypt_detached (secret, nullptr, t->secret, secret_size, t->mac,
+                                                                 nullptr, 0, nonce, issuer.key) == 0) {
+            try {
+                exclusive guard (issuer.lock);
+
+                // forget expired tickets, those can't be redeemed anyway
+
+                issuer.redeemed.erase (issuer.redeemed.begin (),
+                                       issuer.redeemed.lower_bound ((std::uint64_t) (now - lifetime) << 32));
+
+                if (issuer.redeemed.insert (((std::uint64_t) t->timestamp << 32) | t->serial).second)
+                    return true;
+
+            } catch (const std::bad_alloc &) {
+                // can't guarantee single use
+            }
+            sodium_memzero (secret, secret_size);
+        }
+    }
+    return false;
+}
 
 const wchar_t * raddi::protocol::proposal::name () const {
     if (this->outbound_nonce [7] & 0x01) {
@@ -31,7 +128,7 @@ raddi::protocol::xchacha20poly1305::~xchacha20poly1305 () {
     sodium_memzero (static_cast <keyset *> (this), sizeof (keyset));
 }
 
-void raddi::protocol::proposal::propose (raddi::protocol::keyset * head) {
+void raddi::protocol::proposal::propose (raddi::protocol::keyset * head, const ticket * t, const std::uint8_t * secret) {
     randombytes_buf (this->inbound_key, sizeof this->inbound_key);
     randombytes_buf (this->outbound_key, sizeof this->outbound_key);
     randombytes_buf (this->inbound_nonce, sizeof this->inbound_nonce);
@@ -43,26 +140,86 @@ void raddi::protocol::proposal::propose (raddi::protocol::keyset * head) {
         this->outbound_nonce [7] &= ~0x01;
     }
 
-    crypto_scalarmult_base (head->inbound_key, this->inbound_key);
-    crypto_scalarmult_base (head->outbound_key, this->outbound_key);
+    if (t && secret) {
+
+        // resumption
+        //  - ticket replaces inbound key and nonce, 'accept' finds the secret in place of inbound key
+        //  - outbound key is only random filler
+
+        this->outbound_nonce [7] |= 0x02;
+
+        std::memcpy (head->inbound_key, t, sizeof head->inbound_key);
+        std::memcpy (this->inbound_nonce, reinterpret_cast <const std::uint8_t *> (t) + sizeof head->inbound_key, sizeof this->inbound_nonce);
+        std::memcpy (this->inbound_key, secret, resumption::secret_size);
+
+        randombytes_buf (head->outbound_key, sizeof head->outbound_key);
+    } else {
+        this->outbound_nonce [7] &= ~0x02;
+
+        crypto_scalarmult_base (head->inbound_key, this->inbound_key);
+        crypto_scalarmult_base (head->outbound_key, this->outbound_key);
+    }
 
     std::memcpy (head->inbound_nonce, this->inbound_nonce, sizeof this->inbound_nonce);
     std::memcpy (head->outbound_nonce, this->outbound_nonce, sizeof this->outbound_nonce);
 }
 
-raddi::protocol::encryption * raddi::protocol::proposal::accept (const raddi::protocol::keyset * peer) {
-    unsigned char rcvscalarmul [crypto_scalarmult_BYTES];
-    unsigned char trmscalarmul [crypto_scalarmult_BYTES];
+raddi::protocol::encryption * raddi::protocol::proposal::accept (const raddi::protocol::keyset * peer, std::uint8_t * secret) {
+    std::uint8_t resumed [resumption::secret_size];
+    bool resuming = false;
+
+    if (this->outbound_nonce [7] & 0x02) {
+
+        // we presented a ticket
+
+        std::memcpy (resumed, this->inbound_key, sizeof resumed);
+        resuming = true;
+
+    } else
+    if (peer->outbound_nonce [7] & 0x02) {
 
-    crypto_scalarmult (rcvscalarmul, this->inbound_key, peer->outbound_key);
-    crypto_scalarmult (trmscalarmul, this->outbound_key, peer->inbound_key);
-    crypto_generichash (this->inbound_key, sizeof this->inbound_key, rcvscalarmul, sizeof rcvscalarmul,
-                        reinterpret_cast <const unsigned char *> (raddi::protocol::magic), sizeof raddi::protocol::magic);
-    crypto_generichash (this->outbound_key, sizeof this->outbound_key, trmscalarmul, sizeof trmscalarmul,
-                        reinterpret_cast <const unsigned char *> (raddi::protocol::magic), sizeof raddi::protocol::magic);
+        // peer presents a ticket
+        //  - older peers have the bit random, those fail to redeem and proceed with D-H as usual
 
-    sodium_memzero (rcvscalarmul, sizeof rcvscalarmul);
-    sodium_memzero (trmscalarmul, sizeof trmscalarmul);
+        ticket t;
+        std::memcpy (&t, peer->inbound_key, sizeof peer->inbound_key);
+        std::memcpy (reinterpret_cast <std::uint8_t *> (&t) + sizeof peer->inbound_key, peer->inbound_nonce, sizeof peer->inbound_nonce);
+
+        resuming = resumption::redeem (&t, resumed);
+    }
+
+    if (resuming) {
+        derive (this->inbound_key, resumed, peer->outbound_nonce, this->inbound_nonce, sizeof this->inbound_nonce);
+        derive (this->outbound_key, resumed, this->outbound_nonce, peer->inbound_nonce, sizeof this->outbound_nonce);
+        sodium_memzero (resumed, sizeof resumed);
+
+    } else {
+        unsigned char rcvscalarmul [crypto_scalarmult_BYTES];
+        unsigned char trmscalarmul [crypto_scalarmult_BYTES];
+
+        crypto_scalarmult (rcvscalarmul, this->inbound_key, peer->outbound_key);
+        crypto_scalarmult (trmscalarmul, this->outbound_key, peer->inbound_key);
+        crypto_generichash (this->inbound_key, sizeof this->inbound_key, rcvscalarmul, sizeof rcvscalarmul,
+                            reinterpret_cast <const unsigned char *> (raddi::protocol::magic), sizeof raddi::protocol::magic);
+        crypto_generichash (this->outbound_key, sizeof this->outbound_key, trmscalarmul, sizeof trmscalarmul,
+                            reinterpret_cast <const unsigned char *> (raddi::protocol::magic), sizeof raddi::protocol::magic);
+
+        sodium_memzero (rcvscalarmul, sizeof rcvscalarmul);
+        sodium_memzero (trmscalarmul, sizeof trmscalarmul);
+    }
+
+    // resumption secret
+    //  - same for both peers, their inbound and outbound keys are swapped
+
+    if (secret) {
+        std::uint8_t mix [sizeof this->inbound_key];
+        for (auto i = 0u; i != sizeof mix; ++i) {
+            mix [i] = this->inbound_key [i] ^ this->outbound_key [i];
+        }
+        crypto_generichash (secret, resumption::secret_size, mix, sizeof mix,
+                            reinterpret_cast <const unsigned char *> (raddi::protocol::magic), sizeof raddi::protocol::magic);
+        sodium_memzero (mix, sizeof mix);
+    }
     
     if ((aes256gcm_mode != aes256gcm_mode::disabled) && crypto_aead_aes256gcm_is_available () && (peer->outbound_nonce [7] & 0x01)) {
         return new aes256gcm (this, peer);
@@ -46,6 +46,45 @@ namespace raddi {
             std::uint8_t outbound_nonce [std::max (crypto_aead_xchacha20poly1305_ietf_NPUBBYTES, crypto_aead_aes256gcm_NPUBBYTES)];
         };
 
+        // ticket
+        //  - session resumption ticket, see 'resumption' below
+        //  - issued by accepting peer over established connection, connecting peer presents it
+        //    in place of its inbound key and nonce when connecting again
+        //
+        struct ticket {
+            std::uint32_t timestamp; // issue time, together with 'serial' forms encryption nonce
+            std::uint32_t serial;
+            std::uint8_t  secret [crypto_generichash_BYTES]; // encrypted by issuer's ticket key
+            std::uint8_t  mac [crypto_aead_xchacha20poly1305_ietf_ABYTES];
+        };
+        static_assert (sizeof (ticket) == sizeof (keyset::inbound_key) + sizeof (keyset::inbound_nonce),
+                       "ticket must fit in place of inbound key and nonce");
+
+        // resumption
+        //  - reconnecting peer holding a ticket skips the D-H exchange, both peers then derive
+        //    new session keys from the secret carried in the ticket and fresh nonces
+        //  - ticket key is random for every run, tickets are single-use and expire after 'lifetime',
+        //    failed resumption results in failed connection, new one then uses full handshake
+        //
+        namespace resumption {
+            static constexpr std::size_t secret_size = crypto_generichash_BYTES;
+
+            // lifetime
+            //  - seconds for which issued tickets are valid, 0 disables issuing and redeeming tickets
+            //
+            extern std::uint32_t lifetime;
+
+            // issue
+            //  - encrypts 'secret' (derived by 'proposal::accept') into new ticket
+            //
+            bool issue (const std::uint8_t * secret, ticket *);
+
+            // redeem
+            //  - validates and decrypts the ticket into 'secret', the ticket can't be redeemed again
+            //
+            bool redeem (const ticket *, std::uint8_t * secret);
+        }
+
         // encryption
         //  - base interface for aes256gcm and xchacha20poly1305 that handle p2p connection encryption
         //
@@ -79,13 +118,16 @@ namespace raddi {
 
             // propose
             //  - randomizes the proposal and generates communication 'head'
+            //  - if 'ticket' is provided, it's presented to the peer instead of D-H public keys
+            //    and session keys are derived from its 'secret'
             // 
-            void         propose (keyset * head);
+            void         propose (keyset * head, const ticket * = nullptr, const std::uint8_t * secret = nullptr);
 
             // accept
-            //  - finishes D-H and generates encryption object according to peer's proposal
+            //  - finishes D-H, or resumption, and generates encryption object according to peer's proposal
+            //  - 'secret', if provided, receives resumption secret for tickets (resumption::secret_size bytes)
             //
-            encryption * accept (const keyset * head);
+            encryption * accept (const keyset * head, std::uint8_t * secret = nullptr);
 
             // name
             //  - returns name of encryption scheme being proposed
@@ -59,6 +59,14 @@ bool raddi::request::validate (const void * header, std::size_t length) {
             return length == sizeof (request) + sizeof (std::uint16_t)
                 || raddi::log::data (raddi::component::database, 0x23, r->type, length, sizeof (request) + sizeof (std::uint16_t));
 
+        case request::type::ticket:
+            return length == sizeof (request) + sizeof (protocol::ticket)
+                || raddi::log::data (raddi::component::database, 0x23, r->type, length, sizeof (request) + sizeof (protocol::ticket));
+
+        case request::type::batching:
+        case request::type::compression:
+        case request::type::catchup:
+        case request::type::partitioning:
         case request::type::peers:
             return length == sizeof (request)
                 || raddi::log::data (raddi::component::database, 0x23, r->type, length, sizeof (request));
@@ -87,11 +95,32 @@ bool raddi::request::validate (const void * header, std::size_t length) {
             } else
                 return raddi::log::data (raddi::component::database, 0x23, r->type, length, sizeof (request) + request::history::minimal_size);
 
+        case request::type::identities_reconciliation:
+        case request::type::channels_reconciliation:
+            if (length >= sizeof (request) + request::reconciliation::size (1)) {
+                auto content = static_cast <const request::reconciliation *> (r->content ());
+
+                if (!content->is_valid_size (length - sizeof (request)))
+                    return raddi::log::data (raddi::component::database, 0x23, r->type, length, L"14+n8");
+
+                if (raddi::older (content->latest, content->oldest)
+                        || content->width () < content->length (length - sizeof (request)))
+                    return raddi::log::data (raddi::component::database, 0x25, r->type, content->oldest, content->latest,
+                                             content->length (length - sizeof (request)));
+
+                if (raddi::older (content->oldest, raddi::now () - 0x70000000u)) // TODO: 0x70000000u -> settings
+                    return raddi::log::data (raddi::component::database, 0x24,
+                                             r->type, content->oldest, raddi::now () - 0x70000000u, 0x70000000u / (60 * 60 * 24));
+                return true;
+            } else
+                return raddi::log::data (raddi::component::database, 0x23,
+                                         r->type, length, sizeof (request) + request::reconciliation::size (1));
+
        case request::type::subscribe:
             if (length >= sizeof (request) + request::subscription::minimal_size) {
                 auto content = static_cast <const request::subscription *> (r->content ());
 
-                if (!content->history.is_valid_size (length - sizeof (request)))
+                if (!content->history.is_valid_size (length - sizeof (request) - sizeof (eid)))
                     return raddi::log::data (raddi::component::database, 0x23, r->type, length, L"20||26+n6");
 
                 if (raddi::older (content->history.threshold, raddi::now () - 0x02000000u)) // TODO: 0x02000000u -> settings
@@ -114,6 +143,97 @@ bool raddi::request::validate (const void * header, std::size_t length) {
             return length == sizeof (request) + sizeof (download)
                 || raddi::log::data (raddi::component::database, 0x23, r->type, length, sizeof (request) + sizeof (download));
 
+        case request::type::continuation:
+        case request::type::resume:
+            return length == sizeof (request) + sizeof (continuation)
+                || raddi::log::data (raddi::component::database, 0x23, r->type, length, sizeof (request) + sizeof (continuation));
+
+        case request::type::partition:
+            if (length == sizeof (request) + sizeof (partition)) {
+                auto content = static_cast <const request::partition *> (r->content ());
+
+                if (raddi::older (content->latest, content->oldest))
+                    return raddi::log::data (raddi::component::database, 0x25, r->type, content->oldest, content->latest, 1);
+
+                return true;
+            } else
+                return raddi::log::data (raddi::component::database, 0x23, r->type, length, sizeof (request) + sizeof (partition));
+
+        case request::type::tally:
+            return length == sizeof (request) + sizeof (tally)
+                || raddi::log::data (raddi::component::database, 0x23, r->type, length, sizeof (request) + sizeof (tally));
+
+        case request::type::snapshot:
+            return length == sizeof (request) + sizeof (std::uint32_t)
+                || raddi::log::data (raddi::component::database, 0x23, r->type, length, sizeof (request) + sizeof (std::uint32_t));
+
+        case request::type::manifest:
+            if (length >= sizeof (request) + request::manifest::header_size) {
+                auto content = static_cast <const request::manifest *> (r->content ());
+
+                if (!content->is_valid_size (length - sizeof (request)))
+                    return raddi::log::data (raddi::component::database, 0x23, r->type, length, L"8+n20");
+
+                for (auto i = 0u; i != content->length (length - sizeof (request)); ++i) {
+                    if (raddi::older (content->shard [i].latest, content->shard [i].oldest))
+                        return raddi::log::data (raddi::component::database, 0x25, r->type,
+                                                 content->shard [i].oldest, content->shard [i].latest, 1);
+                }
+                return true;
+            } else
+                return raddi::log::data (raddi::component::database, 0x23,
+                                         r->type, length, sizeof (request) + request::manifest::header_size);
+
+        case request::type::subscriptions:
+            if (length >= sizeof (request) + request::subscriptions::size (1)) {
+                auto content = static_cast <const request::subscriptions *> (r->content ());
+
+                if (!content->is_valid_size (length - sizeof (request)))
+                    return raddi::log::data (raddi::component::database, 0x23, r->type, length, L"4+n20");
+
+                for (auto i = 0u; i != content->length (length - sizeof (request)); ++i) {
+                    if (raddi::older (content->channel [i].threshold, raddi::now () - 0x02000000u)) // TODO: 0x02000000u -> settings
+                        return raddi::log::data (raddi::component::database, 0x24, r->type, content->channel [i].threshold,
+                                                 raddi::now () - 0x02000000u, 0x02000000u / (60 * 60 * 24));
+                }
+                return true;
+            } else
+                return raddi::log::data (raddi::component::database, 0x23,
+                                         r->type, length, sizeof (request) + request::subscriptions::size (1));
+
+        case request::type::elaborate:
+            if (length == sizeof (request) + sizeof (elaboration)) {
+                auto content = static_cast <const request::elaboration *> (r->content ());
+
+                if (raddi::older (content->latest, content->oldest))
+                    return raddi::log::data (raddi::component::database, 0x25, r->type, content->oldest, content->latest, 1);
+
+                if (raddi::older (content->oldest, raddi::now () - 0x02000000u)) // TODO: 0x02000000u -> settings
+                    return raddi::log::data (raddi::component::database, 0x24,
+                                             r->type, content->oldest, raddi::now () - 0x02000000u, 0x02000000u / (60 * 60 * 24));
+                return true;
+            } else
+                return raddi::log::data (raddi::component::database, 0x23, r->type, length, sizeof (request) + sizeof (elaboration));
+
+        case request::type::breakdown:
+            if (length >= sizeof (request) + request::breakdown::minimal_size) {
+                auto content = static_cast <const request::breakdown *> (r->content ());
+
+                if (!content->history.is_valid_size (length - sizeof (request) - sizeof (eid) - sizeof (std::uint32_t)))
+                    return raddi::log::data (raddi::component::database, 0x23, r->type, length, L"24||30+n6");
+
+                if (!raddi::older (content->oldest, content->history.threshold))
+                    return raddi::log::data (raddi::component::database, 0x25, r->type, content->oldest, content->history.threshold,
+                                             content->history.length (length - sizeof (request) - sizeof (eid) - sizeof (std::uint32_t)));
+
+                if (raddi::older (content->oldest, raddi::now () - 0x02000000u)) // TODO: 0x02000000u -> settings
+                    return raddi::log::data (raddi::component::database, 0x24,
+                                             r->type, content->oldest, raddi::now () - 0x02000000u, 0x02000000u / (60 * 60 * 24));
+                return true;
+            } else
+                return raddi::log::data (raddi::component::database, 0x23,
+                                         r->type, length, sizeof (request) + request::breakdown::minimal_size);
+
         default:
             // unknown requests are allowed (but ignored) for forward compatibility
             raddi::log::data (raddi::component::database, 0x22, (unsigned int) r->type);
@@ -2,6 +2,7 @@
 #define RADDI_REQUEST_H
 
 #include "raddi_entry.h"
+#include "raddi_protocol.h"
 
 #include <cstddef>
 #include <cstdint>
@@ -46,6 +47,24 @@ namespace raddi {
             //
             listening = 0x02,
 
+            // ticket -> protocol::ticket
+            //  - session resumption ticket the peer can present when connecting to us again,
+            //    see protocol::resumption; sent only over inbound connections
+            //
+            ticket = 0x03,
+
+            // batching
+            //  - announces the peer demultiplexes batch frames, see connection::dispatch
+            //  - no additional data
+            //
+            batching = 0x04,
+
+            // compression
+            //  - announces the peer decompresses batch frames compressed by LZMA2, see connection::compress
+            //  - no additional data
+            //
+            compression = 0x05,
+
             // peers
             //  - requests small random sample of peer IP addresses
             //  - no additional data
@@ -67,6 +86,14 @@ namespace raddi {
             channels = 0x21,
             // threads = 0x22?? or 'download'
 
+            // identities_reconciliation/channels_reconciliation -> reconciliation
+            //  - reconciles identities or channels with the peer, see 'reconciliation' below
+            //  - sent in response to 'identities'/'channels' history request with flag 0x0002
+            //    instead of transmitting whole span in which the peer has less entries
+            //
+            identities_reconciliation = 0x24,
+            channels_reconciliation = 0x25,
+
             // subscribe -> subscription
             //  - requests subscription to particular 
             //
@@ -90,6 +117,83 @@ namespace raddi {
             //  - if eid is nested post, whole thread gets fetched
             //
             download = 0x33,
+
+            // elaborate -> elaboration
+            //  - requests finer breakdown of a history span, from 'subscribe' with flag 0x0001 set,
+            //    in which we have more entries than the peer, the peer replies with 'breakdown'
+            //
+            elaborate = 0x34,
+
+            // breakdown -> breakdown
+            //  - peer's history of channel within range requested by 'elaborate', in finer spans
+            //  - spans that still differ are elaborated further, until small enough to transmit
+            //
+            breakdown = 0x35,
+
+            // continuation -> request::continuation
+            //  - position of 'download' being streamed to us, sent by the peer after every chunk,
+            //    in order with the entries; null 'position' when the download is complete
+            //
+            continuation = 0x36,
+
+            // resume -> request::continuation
+            //  - requests the peer to continue download interrupted by disconnection
+            //    after the last received 'continuation' position
+            //
+            resume = 0x37,
+
+            // partition -> request::partition
+            //  - requests full database download limited to 'oldest'..'latest' range,
+            //    continuing after 'position' if not null; allowed only between core nodes
+            //  - the peer replies with 'tally' and streams the range like 'download'
+            //
+            partition = 0x38,
+
+            // tally -> request::tally
+            //  - number of entries the peer has in the 'partition' range it's going to stream,
+            //    so that short transfer can be detected and requested from another core node
+            //
+            tally = 0x39,
+
+            // snapshot -> std::uint32_t
+            //  - requests manifest of peer's immutable (all but the newest) data shards,
+            //    containing entries created at or after the timestamp; allowed only between core nodes
+            //  - the peer replies with one or more 'manifest' requests, shards that differ from
+            //    what we have are then downloaded by 'partition'
+            //  - the timestamp is clamped to peer's synchronization window, history older than
+            //    the first shard in manifest is downloaded by 'partition' split by time
+            //
+            snapshot = 0x3A,
+
+            // manifest -> request::manifest
+            //  - part of peer's reply to 'snapshot'
+            //
+            manifest = 0x3B,
+
+            // catchup
+            //  - announces the peer serves batched 'subscriptions', no additional data
+            //  - sent ahead of 'initial' so that it's known when the peer corroborates the connection
+            //    and starts subscribing
+            //
+            catchup = 0x3C,
+
+            // subscriptions -> request::subscriptions
+            //  - subscribes to multiple channels at once, each with single span of history,
+            //    sent on connection to peers that announced 'catchup' instead of 'subscribe' for each
+            //
+            subscriptions = 0x3D,
+
+            // partitioning
+            //  - announces the peer serves 'partition' (and replies with 'tally'), no additional data
+            //  - sent ahead of 'initial', core nodes that don't announce it are asked for plain 'download'
+            //
+            partitioning = 0x3E,
+
+            // batch
+            //  - reserved, header of this type with zero mark starts batch frame, see connection::batch_mark
+            //  - never transmitted as a request
+            //
+            batch = 0xFF,
         };
         type type : 8;
 
@@ -146,7 +250,8 @@ namespace raddi {
             std::uint32_t threshold;
 
             // flags
-            //  - TODO: 0x0001 - if set, peer can (when supported) ask for more details by 'detail_xxx' request
+            //  - 0x0001 - if set, peer can ask for finer breakdown of spans by 'elaborate' request (subscriptions only)
+            //  - 0x0002 - peer supports 'reconciliation' of spans that differ (identities and channels only)
             //  - other bits are reserved for future use and should remain 0 by default
             //
             std::uint16_t flags;
@@ -211,11 +316,82 @@ namespace raddi {
         //  - peer requests to receive all relevant data created after 'threshold' timestamp
         //    and everything within each 'span' if the peer has more data than 'number'
         //  - size limit of max_payload (133) means 21 ('depth') spans maximum
-        //  - TODO: in future, the other side could ask, to break down a particular 'span' (that differs)
-        //          in order find better matching
+        //  - spans of subscription history, that differ, can be broken down, see 'elaboration'
         //
         using history = short_history <0>;
 
+        // reconciliation
+        //  - range-based set reconciliation, content following 'identities_reconciliation'
+        //    or 'channels_reconciliation' request header
+        //  - range 'oldest'..'latest' (inclusive) is divided evenly into 'part's (as many as the size allows),
+        //    for each the sender reports number of entries it has and XOR of short hashes of their IDs
+        //  - receiver compares the parts against own data and for each that differs:
+        //     - having only few ('leaf') entries, or the part can't be divided further, sends them all,
+        //       and, unless 'final' flag is set, replies with the part undivided and 'final' flag set
+        //       for the peer to send its entries too
+        //     - otherwise replies with the part divided further and own numbers and digests
+        //  - 'round' is incremented with every reply, reconciliation is abandoned after 'max_rounds'
+        //  - ranges reaching beyond receiver's synchronization window are ignored
+        //
+        struct reconciliation {
+            std::uint32_t oldest;
+            std::uint32_t latest;
+            std::uint8_t  round;
+            std::uint8_t  flags; // 0x01 - final, sender already sent all its entries within the part
+
+            struct part {
+                std::uint8_t digest [6]; // lower 48 bits of the digest, little endian
+                std::uint8_t number [2]; // little endian, 0xFFFF means 65535 or more
+            };
+
+            static constexpr std::size_t header_size = 10;
+            static constexpr std::size_t max_parts = (raddi::request::max_payload - header_size) / sizeof (struct part);
+            static constexpr std::size_t leaf = 24;
+            static constexpr std::size_t max_rounds = 32;
+
+            struct part part [max_parts];
+
+        public:
+            // length converts 'size' in bytes to 'part' array length
+            static constexpr std::size_t length (std::size_t size) {
+                return (size - header_size) / sizeof (struct part);
+            }
+            static constexpr bool is_valid_size (std::size_t size) {
+                return size >= header_size + sizeof (struct part)
+                    && size <= request::max_payload
+                    && (size - header_size) % sizeof (struct part) == 0;
+            }
+
+            // size converts 'part' array 'length' to size in bytes
+            static constexpr std::size_t size (std::size_t length) {
+                return header_size + length * sizeof (struct part);
+            }
+
+            // width
+            //  - number of seconds the range spans, i.e. max parts it can be divided into
+            //
+            std::uint64_t width () const {
+                return std::uint64_t (this->latest - this->oldest) + 1;
+            }
+
+            // index
+            //  - returns index of part (of 'n' parts) the timestamp 't' belongs to
+            //
+            std::size_t index (std::uint32_t t, std::size_t n) const {
+                return std::size_t (std::uint64_t (t - this->oldest) * n / this->width ());
+            }
+
+            // bounds
+            //  - returns first and last timestamp of part 'i' (of 'n' parts)
+            //
+            std::pair <std::uint32_t, std::uint32_t> bounds (std::size_t i, std::size_t n) const {
+                return {
+                    this->oldest + std::uint32_t ((this->width () * i + n - 1) / n),
+                    this->oldest + std::uint32_t ((this->width () * (i + 1) + n - 1) / n) - 1
+                };
+            }
+        };
+
         // subscription
         //  - content following request header with type == 'subscribe'
         //  - peer subscribes to receive entries descending 'channel' (can also be thread, TODO: verify)
@@ -231,10 +407,153 @@ namespace raddi {
             }
 
             static constexpr std::size_t    depth = decltype (history) ::depth;
+
+            // compatible_depth
+            //  - peers that didn't announce 'catchup' (older versions) accept 121 bytes at most, i.e. 17 spans
+            //
+            static constexpr std::size_t    compatible_depth = 17;
             static constexpr std::size_t    minimal_size = sizeof (eid)
                                                          + decltype (request::subscription::history)::minimal_size;
         };
         
+        // continuation
+        //  - content following request header with type == 'continuation' or 'resume'
+        //  - identifies download by its 'parent', 'position' is the last entry transmitted
+        //
+        struct continuation {
+            eid             parent;
+            eid             position;
+        };
+
+        // partition
+        //  - content following request header with type == 'partition'
+        //
+        struct partition {
+            std::uint32_t   oldest;
+            std::uint32_t   latest;
+            eid             position;
+        };
+
+        // tally
+        //  - content following request header with type == 'tally'
+        //
+        struct tally {
+            std::uint32_t   oldest;
+            std::uint32_t   latest;
+            std::uint32_t   count;
+        };
+
+        // manifest
+        //  - content following request header with type == 'manifest'
+        //  - describes up to 'max_shards' shards, for each its range, number of rows and digest,
+        //    XOR of short hashes of all entry IDs in the shard (same as in 'reconciliation')
+        //  - last manifest in reply to 'snapshot' has 'final' flag set, even if empty
+        //
+        struct manifest {
+            std::uint32_t flags; // 0x01 - final
+
+            struct shard {
+                std::uint32_t oldest;
+                std::uint32_t latest;
+                std::uint32_t rows;
+                std::uint8_t  digest [8]; // little endian
+            };
+
+            static constexpr std::size_t header_size = sizeof (std::uint32_t);
+            static constexpr std::size_t max_shards = (raddi::request::max_payload - header_size) / sizeof (struct shard);
+
+            struct shard shard [max_shards];
+
+        public:
+            // length converts 'size' in bytes to 'shard' array length
+            static constexpr std::size_t length (std::size_t size) {
+                return (size - header_size) / sizeof (struct shard);
+            }
+            static constexpr bool is_valid_size (std::size_t size) {
+                return size >= header_size
+                    && size <= request::max_payload
+                    && (size - header_size) % sizeof (struct shard) == 0;
+            }
+
+            // size converts 'shard' array 'length' to size in bytes
+            static constexpr std::size_t size (std::size_t length) {
+                return header_size + length * sizeof (struct shard);
+            }
+        };
+
+        // subscriptions
+        //  - content following request header with type == 'subscriptions'
+        //  - for each 'channel' the peer sends all entries created at or after 'threshold',
+        //    unless it has no more than 'number' of them, and thread-level entries older than that
+        //  - if it has more, and 'number' is not below 'elaboration::minimum', the peer asks for
+        //    breakdown of the span by 'elaborate' instead, as with 'subscribe' with flag 0x0001
+        //  - channels of consecutive requests are accumulated by the peer until the 'final' one,
+        //    then all are served together by single pass over the database
+        //
+        struct subscriptions {
+            std::uint32_t flags; // 0x01 - final
+
+            struct channel {
+                eid           channel;
+                std::uint32_t threshold;
+                std::uint32_t number;
+            };
+
+            static constexpr std::size_t header_size = sizeof (std::uint32_t);
+            static constexpr std::size_t max_channels = (raddi::request::max_payload - header_size) / sizeof (struct channel);
+
+            struct channel channel [max_channels];
+
+        public:
+            // length converts 'size' in bytes to 'channel' array length
+            static constexpr std::size_t length (std::size_t size) {
+                return (size - header_size) / sizeof (struct channel);
+            }
+            static constexpr bool is_valid_size (std::size_t size) {
+                return size >= header_size
+                    && size <= request::max_payload
+                    && (size - header_size) % sizeof (struct channel) == 0;
+            }
+
+            // size converts 'channel' array 'length' to size in bytes
+            static constexpr std::size_t size (std::size_t length) {
+                return header_size + length * sizeof (struct channel);
+            }
+        };
+
+        // elaboration
+        //  - content following request header with type == 'elaborate'
+        //  - asks peer to break down its history of 'channel' between 'oldest' and 'latest' (inclusive)
+        //  - 'minimum' - spans in which the peer has less entries are not worth elaborating, transmitted whole
+        //
+        struct elaboration {
+            eid             channel;
+            std::uint32_t   oldest;
+            std::uint32_t   latest;
+
+            static constexpr std::uint32_t minimum = 32;
+        };
+
+        // breakdown
+        //  - content following request header with type == 'breakdown'
+        //  - 'history' of 'channel' from 'oldest' up to 'history.threshold' (exclusive), in roughly equal spans
+        //  - spans without entries are merged with neighbours, no spans means no entries in the range
+        //
+        struct breakdown {
+            eid                                                      channel;
+            std::uint32_t                                            oldest;
+            short_history <sizeof (eid) + sizeof (std::uint32_t)>    history;
+
+            static constexpr std::size_t size (std::size_t length) {
+                return sizeof (eid) + sizeof (std::uint32_t)
+                     + short_history <sizeof (eid) + sizeof (std::uint32_t)> ::size (length);
+            }
+
+            static constexpr std::size_t    depth = decltype (history) ::depth;
+            static constexpr std::size_t    minimal_size = sizeof (eid) + sizeof (std::uint32_t)
+                                                         + decltype (request::breakdown::history)::minimal_size;
+        };
+
         // download
         //  - content following request header with type == 'download'
         //  - peer requests to immediately download all entries that descend 'parent' channel or thread
@@ -255,14 +574,31 @@ namespace raddi {
             case request::type::initial: return L"init";
             case request::type::security_check: return L"security check";
             case request::type::listening: return L"listening";
+            case request::type::ticket: return L"ticket";
+            case request::type::batching: return L"batching";
+            case request::type::compression: return L"compression";
             case request::type::peers: return L"peers";
             case request::type::ipv4peer: return L"IPv4 peer";
             case request::type::ipv6peer: return L"IPv6 peer";
             case request::type::identities: return L"identities";
             case request::type::channels: return L"channels";
+            case request::type::identities_reconciliation: return L"identities reconciliation";
+            case request::type::channels_reconciliation: return L"channels reconciliation";
             case request::type::subscribe: return L"subscribe";
             case request::type::everything: return L"everything";
             case request::type::download: return L"download";
+            case request::type::elaborate: return L"elaborate";
+            case request::type::breakdown: return L"breakdown";
+            case request::type::continuation: return L"continuation";
+            case request::type::resume: return L"resume";
+            case request::type::partition: return L"partition";
+            case request::type::tally: return L"tally";
+            case request::type::snapshot: return L"snapshot";
+            case request::type::manifest: return L"manifest";
+            case request::type::catchup: return L"catchup";
+            case request::type::subscriptions: return L"subscriptions";
+            case request::type::partitioning: return L"partitioning";
+            case request::type::batch: return L"batch";
             case request::type::unsubscribe: return L"unsubscribe";
         }
         return std::to_wstring ((std::uint8_t) type);
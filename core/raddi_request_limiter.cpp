@@ -0,0 +1,75 @@
+#include "raddi_request_limiter.h"
+#include "raddi_timestamp.h"
+
+void raddi::request_limiter::advance (std::uint32_t now) noexcept {
+    const auto n = sizeof this->buckets / sizeof this->buckets [0];
+
+    if (raddi::older (this->latest, now)) {
+        if (now - this->latest >= n) {
+            for (auto & bucket : this->buckets) {
+                bucket = 0;
+            }
+            this->sum = 0;
+        } else {
+            for (auto t = this->latest + 1; t != now + 1; ++t) {
+                this->sum -= this->buckets [t % n];
+                this->buckets [t % n] = 0;
+            }
+        }
+        this->latest = now;
+    }
+}
+
+std::uint32_t raddi::request_limiter::charge (std::uint32_t now, std::uint32_t cost) noexcept {
+    this->advance (now);
+
+    // if time moved backwards, charge to the most recent bucket
+
+    this->buckets [this->latest % (sizeof this->buckets / sizeof this->buckets [0])] += cost;
+    this->sum += cost;
+    return this->sum;
+}
+
+std::uint32_t raddi::request_limiter::cost (enum class request::type t) noexcept {
+    switch (t) {
+        case request::type::initial:
+        case request::type::security_check:
+        case request::type::listening:
+        case request::type::ticket:
+        case request::type::batching:
+        case request::type::compression:
+        case request::type::catchup:
+        case request::type::partitioning:
+        case request::type::batch:
+        case request::type::ipv4peer:
+        case request::type::ipv6peer:
+        case request::type::unsubscribe:
+        case request::type::everything:
+        case request::type::continuation:
+        case request::type::tally:
+        case request::type::manifest:
+            return 1;
+
+        case request::type::peers:
+            return 4; // coordinator also charges additional penalty
+
+        case request::type::breakdown:
+            return 4;
+
+        case request::type::identities:
+        case request::type::channels:
+        case request::type::subscribe:
+        case request::type::subscriptions:
+        case request::type::elaborate:
+        case request::type::identities_reconciliation:
+        case request::type::channels_reconciliation:
+            return 16; // reconciliation digests whole range in single pass
+
+        case request::type::download:
+        case request::type::resume:
+        case request::type::partition:
+        case request::type::snapshot:
+            return 32;
+    }
+    return 1;
+}
@@ -0,0 +1,53 @@
+#ifndef RADDI_REQUEST_LIMITER_H
+#define RADDI_REQUEST_LIMITER_H
+
+#include "raddi_request.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace raddi {
+
+    // request_limiter
+    //  - per-connection sliding window of request costs over last minute
+    //  - fixed ring of one-second buckets, no allocations
+    //  - not synchronized, connection's requests are processed sequentially
+    //
+    class request_limiter {
+        std::uint32_t buckets [60] = {};
+        std::uint32_t latest = 0; // timestamp of the most recent bucket
+        std::uint32_t sum = 0; // sum of all buckets
+
+    public:
+        std::uint32_t report_time = 0; // last time the limit was reported, see coordinator::process
+
+    public:
+
+        // charge
+        //  - adds 'cost' of a request processed at 'now' into the window
+        //  - returns total cost charged within last minute, including this one
+        //
+        std::uint32_t charge (std::uint32_t now, std::uint32_t cost) noexcept;
+
+        // total
+        //  - returns total cost charged within last minute (as of the most recent charge)
+        //
+        std::uint32_t total () const noexcept { return this->sum; }
+
+        // cost
+        //  - relative cost of processing a request of type 't'
+        //  - history and download requests scan database tables and potentially
+        //    generate lots of responses, thus are much more expensive
+        //  - weights approximate table rows touched: 16 for requests scanning one channel's
+        //    history or one reconciliation range, 32 for downloads that stream all entries
+        //    of a range; the default limit is scaled by 16 so that subscribing to as many
+        //    channels as before still fits in a minute
+        //
+        static std::uint32_t cost (enum class request::type t) noexcept;
+
+    private:
+        void advance (std::uint32_t now) noexcept;
+    };
+}
+
+#endif
@@ -19,7 +19,7 @@ namespace raddi {
     class subscription_set
         : log::provider <component::database> {
 
-        mutable ::lock                  lock;
+        mutable ::biased_lock           lock;
         std::map <uuid, subscriptions>  data;
         const std::wstring              path;
 
@@ -0,0 +1,74 @@
+#ifndef RADDI_TIMER_WHEEL_H
+#define RADDI_TIMER_WHEEL_H
+
+#include <cstdint>
+#include <vector>
+
+namespace raddi {
+
+    // timer_wheel
+    //  - hierarchical timing wheel of 'Levels' wheels, 'Slots' buckets each
+    //  - buckets of the first level are 'Resolution' microseconds long, every next level's
+    //    buckets span whole previous level; their items are redistributed (cascaded)
+    //    into lower levels once their bucket's time comes
+    //  - scheduling and expiring items is O(1), items beyond the span of the wheel
+    //    (Slots^Levels * Resolution) are clamped to its last bucket
+    //  - NOTE: not synchronized, the owner provides locking
+    //
+    template <typename T, std::size_t Slots, std::uint64_t Resolution, std::size_t Levels = 1>
+    class timer_wheel {
+        static_assert (Slots && !(Slots & (Slots - 1)), "Slots must be power of 2");
+        static_assert (Levels > 0, "Levels must be at least 1");
+
+        struct item {
+            std::uint64_t t; // tick at which the item expires
+            T             value;
+        };
+
+        std::vector <item> slots [Levels][Slots];
+        std::size_t        counts [Levels] = {};
+        std::uint64_t      tick = 0; // next tick (microtimestamp / Resolution) to expire
+        std::size_t        count = 0;
+
+        static constexpr std::uint64_t shift (std::size_t level) {
+            return level ? shift (level - 1) * Slots : 1;
+        }
+        std::uint64_t insert (item &&);
+        void cascade (std::size_t level);
+
+    public:
+        static constexpr std::uint64_t span = shift (Levels) * Resolution;
+
+        // schedule
+        //  - inserts 'value' to expire 'delay' microseconds after 'now'
+        //  - returns the deadline (microtimestamp) the value was actually scheduled for
+        //
+        std::uint64_t schedule (std::uint64_t now, std::uint64_t delay, const T & value);
+
+        // advance
+        //  - expires all items scheduled up to 'now', passing each value to 'callback'
+        //  - the 'callback' may schedule the value again
+        //  - returns number of items expired
+        //
+        template <typename F>
+        std::size_t advance (std::uint64_t now, F callback);
+
+        // erase_if
+        //  - removes all items for which the 'predicate' returns true
+        //
+        template <typename P>
+        std::size_t erase_if (P predicate);
+
+        // next
+        //  - returns deadline (microtimestamp) of the nearest non-empty bucket, or 0 if empty
+        //  - for items on higher levels this is only a beginning of their bucket, i.e. earlier
+        //
+        std::uint64_t next () const;
+
+        std::size_t size () const { return this->count; }
+        bool empty () const { return this->count == 0; }
+    };
+}
+
+#include "raddi_timer_wheel.tcc"
+#endif
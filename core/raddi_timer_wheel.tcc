@@ -0,0 +1,154 @@
+#ifndef RADDI_TIMER_WHEEL_TCC
+#define RADDI_TIMER_WHEEL_TCC
+
+template <typename T, std::size_t Slots, std::uint64_t Resolution, std::size_t Levels>
+std::uint64_t raddi::timer_wheel <T, Slots, Resolution, Levels>::schedule (std::uint64_t now, std::uint64_t delay, const T & value) {
+    const auto current = now / Resolution;
+    if (this->count == 0 && this->tick < current) {
+        this->tick = current;
+    }
+
+    auto t = (now + delay + Resolution - 1) / Resolution;
+    if (t < this->tick) {
+        t = this->tick;
+    }
+
+    return this->insert ({ t, value }) * Resolution;
+}
+
+template <typename T, std::size_t Slots, std::uint64_t Resolution, std::size_t Levels>
+std::uint64_t raddi::timer_wheel <T, Slots, Resolution, Levels>::insert (item && x) {
+
+    // lowest level where the item fits within one revolution from current tick
+
+    auto level = 0u;
+    while ((level != Levels - 1) && (x.t / shift (level) - this->tick / shift (level) >= Slots)) {
+        ++level;
+    }
+
+    if (x.t / shift (level) - this->tick / shift (level) >= Slots) {
+        x.t = (this->tick / shift (level) + Slots - 1) * shift (level);
+    }
+
+    const auto t = x.t;
+    this->slots [level][(t / shift (level)) % Slots].push_back (std::move (x));
+    this->counts [level]++;
+    this->count++;
+    return t;
+}
+
+template <typename T, std::size_t Slots, std::uint64_t Resolution, std::size_t Levels>
+void raddi::timer_wheel <T, Slots, Resolution, Levels>::cascade (std::size_t level) {
+    auto & slot = this->slots [level][(this->tick / shift (level)) % Slots];
+    if (!slot.empty ()) {
+        std::vector <item> items;
+        items.swap (slot);
+
+        this->counts [level] -= items.size ();
+        this->count -= items.size ();
+
+        for (auto & x : items) {
+            this->insert (std::move (x));
+        }
+    }
+}
+
+template <typename T, std::size_t Slots, std::uint64_t Resolution, std::size_t Levels>
+template <typename F>
+std::size_t raddi::timer_wheel <T, Slots, Resolution, Levels>::advance (std::uint64_t now, F callback) {
+    const auto current = now / Resolution;
+    std::size_t n = 0;
+    std::vector <item> expired;
+
+    while (this->count && (this->tick <= current)) {
+
+        // entering new bucket of higher level, redistribute its items down
+
+        for (auto level = Levels - 1; level != 0; --level) {
+            if (this->tick % shift (level) == 0) {
+                this->cascade (level);
+            }
+        }
+
+        auto & slot = this->slots [0][this->tick++ % Slots];
+        if (!slot.empty ()) {
+
+            // tick is already advanced, so callback can schedule the item again
+
+            expired.swap (slot);
+            this->counts [0] -= expired.size ();
+            this->count -= expired.size ();
+
+            for (auto & x : expired) {
+                callback (x.value);
+            }
+            n += expired.size ();
+            expired.clear ();
+        }
+
+        // skip empty levels to the next bucket of the lowest non-empty level
+
+        if (this->count && !this->counts [0]) {
+            auto level = 1u;
+            while (!this->counts [level]) {
+                ++level;
+            }
+
+            const auto s = shift (level);
+            const auto t = (this->tick + s - 1) / s * s;
+
+            this->tick = (t < current + 1) ? t : current + 1;
+        }
+    }
+    if (this->count == 0 && this->tick <= current) {
+        this->tick = current + 1;
+    }
+    return n;
+}
+
+template <typename T, std::size_t Slots, std::uint64_t Resolution, std::size_t Levels>
+template <typename P>
+std::size_t raddi::timer_wheel <T, Slots, Resolution, Levels>::erase_if (P predicate) {
+    std::size_t n = 0;
+    for (auto level = 0u; level != Levels; ++level) {
+        for (auto & slot : this->slots [level]) {
+            auto i = slot.begin ();
+            while (i != slot.end ()) {
+                if (predicate (i->value)) {
+                    if (&*i != &slot.back ()) {
+                        *i = std::move (slot.back ());
+                    }
+                    slot.pop_back ();
+                    this->counts [level]--;
+                    ++n;
+                } else {
+                    ++i;
+                }
+            }
+        }
+    }
+    this->count -= n;
+    return n;
+}
+
+template <typename T, std::size_t Slots, std::uint64_t Resolution, std::size_t Levels>
+std::uint64_t raddi::timer_wheel <T, Slots, Resolution, Levels>::next () const {
+    std::uint64_t nearest = 0;
+    for (auto level = 0u; level != Levels; ++level) {
+        if (this->counts [level]) {
+            const auto s = shift (level);
+            for (auto t = this->tick / s; t != this->tick / s + Slots; ++t) {
+                if (!this->slots [level][t % Slots].empty ()) {
+                    const auto deadline = (t * s > this->tick) ? t * s : this->tick;
+                    if (!nearest || (deadline < nearest)) {
+                        nearest = deadline;
+                    }
+                    break;
+                }
+            }
+        }
+    }
+    return nearest * Resolution;
+}
+
+#endif
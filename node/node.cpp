@@ -13,6 +13,7 @@
 #include <stdexcept>
 #include <cstdarg>
 #include <list>
+#include <vector>
 
 #include <sodium.h>
 #include <lzma.h>
@@ -69,6 +70,40 @@ namespace {
     bool embrace (raddi::connection * source, const raddi::entry * entry, std::size_t size, std::size_t nesting = 0);
     bool assess_proof_requirements (const void * entry, std::size_t size, bool & disconnect);
 
+    // GetQueuedCompletionStatusEx
+    //  - Vista+, allows workers to dequeue multiple completions per single kernel transition
+    //  - RtlNtStatusToDosError then translates status of each failed one for error reporting
+    //
+    BOOL (WINAPI * pGetQueuedCompletionStatusEx) (HANDLE, LPOVERLAPPED_ENTRY, ULONG, PULONG, DWORD, BOOL) = NULL;
+    ULONG (WINAPI * pRtlNtStatusToDosError) (LONG) = NULL;
+
+    // completions_per_dequeue
+    //  - number of completions a worker dequeues at once when GetQueuedCompletionStatusEx is available
+    //  - kept low so that a single busy worker doesn't hold completions other idle workers could process
+    //
+    static constexpr ULONG completions_per_dequeue = 16;
+
+    // dequeue_timeout
+    //  - milliseconds a worker waits for completions before returning to finish its (empty) batch,
+    //    this bounds how long 'drain' waits for idle workers
+    //
+    static constexpr DWORD dequeue_timeout = 100;
+
+    // batches
+    //  - per-worker sequence, odd from before the worker dequeues completions until it
+    //    dispatched all of them, i.e. also while waiting for them
+    //  - connection may retire while processing one completion of the batch while another,
+    //    not yet dispatched, still points to it; 'drain' waits for batches in progress to finish
+    //    so that 'sweep' doesn't free such connection
+    //  - while 'draining' is set, workers signal 'drained' event whenever they finish a batch
+    //
+    std::vector <LONG> batches;
+    LONG draining = 0;
+    HANDLE drained = NULL;
+    void drain ();
+
+    bool complete (int i, DWORD id, BOOL success, DWORD n, ULONG_PTR key, OVERLAPPED * overlapped);
+
     std::size_t          workers = 0;
     raddi::db *          database = nullptr;
     raddi::coordinator * coordinator = nullptr;
@@ -94,6 +129,9 @@ int wmain (int argc, wchar_t ** argw) {
 
         if (IsWindowsVistaOrGreater ()) {
             status.dwControlsAccepted |= SERVICE_ACCEPT_PRESHUTDOWN;
+
+            Symbol (GetModuleHandle (L"KERNEL32"), pGetQueuedCompletionStatusEx, "GetQueuedCompletionStatusEx");
+            Symbol (GetModuleHandle (L"NTDLL"), pRtlNtStatusToDosError, "RtlNtStatusToDosError");
         }
         if (IsWindows7OrGreater ()) {
             status.dwControlsAccepted |= SERVICE_ACCEPT_TIMECHANGE;
@@ -166,6 +204,18 @@ void raddi::connection::out_of_memory () {
 void raddi::connection::discord () {
     ::coordinator->disagreed (this);
 }
+void raddi::connection::tally () {
+    ::coordinator->tally (this);
+}
+std::uint64_t raddi::connection::throttle () {
+    return ::coordinator->throttle (this);
+}
+bool raddi::connection::suspended (std::uint64_t delay) {
+    return ::coordinator->suspend (this, delay);
+}
+bool raddi::connection::resumable (raddi::protocol::ticket * ticket, std::uint8_t * secret) {
+    return ::coordinator->resumable (this->peer, ticket, secret);
+}
 void raddi::connection::disconnected () {
     if (this->secured) {
         this->report (raddi::log::level::event, 2, this->peer);
@@ -174,6 +224,7 @@ void raddi::connection::disconnected () {
         ::coordinator->unavailable (this);
     }
 
+    ::coordinator->tally (this, true);
     this->Socket::disconnect ();
     this->secured = false;
     this->retired = true; // 'this' can cease to exist at any time after this line
@@ -190,7 +241,7 @@ bool raddi::connection::head (const raddi::protocol::keyset * peer) {
         return false;
     }
 
-    if (auto ee = this->proposal->accept (peer)) {
+    if (auto ee = this->proposal->accept (peer, this->resumption)) {
 
         // replace proposal with encryption
         delete this->proposal;
@@ -502,7 +553,7 @@ namespace {
 
                             // redistribute to other connections even if detached, others may already have the parent
                             if (broadcast) {
-                                auto n = coordinator->broadcast (top, entry, size);
+                                auto n = coordinator->broadcast (top, entry, size, source != nullptr);
 
                                 if (source == nullptr) {
                                     raddi::log::event (raddi::component::main, 0x21, entry->id, n);
@@ -571,7 +622,7 @@ namespace {
                     //  - generaly old entries are comming back only on request
 
                     if (!old) {
-                        coordinator->broadcast (top, entry, size);
+                        coordinator->broadcast (top, entry, size, source != nullptr);
                     }
                     return true;
                 }
@@ -609,11 +660,15 @@ namespace {
 
                         if (inserted) {
 
+                            // cached downloads of the channel and thread are no longer complete
+
+                            coordinator->inserted (top);
+
                             // redistribute to other connections if not old (would be rejected anyway)
                             //  - generaly old entries are comming back only on request
 
                             if (broadcast && !old) {
-                                auto n = coordinator->broadcast (top, entry, size);
+                                auto n = coordinator->broadcast (top, entry, size, source != nullptr);
 
                                 if (source == nullptr) {
                                     raddi::log::event (raddi::component::main, 0x21, entry->id, n);
@@ -831,10 +886,27 @@ namespace {
         option (argc, argw, L"local", coordinator.settings.local_peers_only); // 'local-peers-only'?
         option (argc, argw, L"network-propagation-participation", coordinator.settings.network_propagation_participation);
         option (argc, argw, L"channels-synchronization-participation", coordinator.settings.channels_synchronization_participation);
+        option (argc, argw, L"channels-reconciliation", coordinator.settings.channels_reconciliation);
         option (argc, argw, L"full-database-downloads", coordinator.settings.full_database_downloads_allowed);
         option (argc, argw, L"full-database-download-limit", coordinator.settings.full_database_download_limit);
+        option (argc, argw, L"partition-timeout", coordinator.settings.partition_timeout);
+        option (argc, argw, L"snapshots", coordinator.settings.snapshots_allowed);
+        option (argc, argw, L"snapshot-synchronization", coordinator.settings.snapshot_synchronization);
+        option (argc, argw, L"download-chunk-size", coordinator.settings.download_chunk_size);
+        option (argc, argw, L"max-concurrent-downloads", coordinator.settings.max_concurrent_downloads);
+        option (argc, argw, L"max-requests-per-minute", coordinator.settings.max_requests_per_minute);
+        option (argc, argw, L"download-cache-lifetime", coordinator.settings.download_cache_lifetime);
+        option (argc, argw, L"download-cache-limit", coordinator.settings.download_cache_limit);
 
         option (argc, argw, L"keep-alive", coordinator.settings.keep_alive_period);
+        option (argc, argw, L"transmit-buffer-limit", Transmitter::limit);
+        option (argc, argw, L"batch-compression", raddi::batch_compression);
+        option (argc, argw, L"batch-compression-level", raddi::batch_compression_level);
+        option (argc, argw, L"broadcast-delay", coordinator.settings.broadcast_delay);
+        option (argc, argw, L"relayed-broadcast-delay", coordinator.settings.relayed_broadcast_delay);
+        option (argc, argw, L"receive-credit", coordinator.settings.receive_credit);
+        option (argc, argw, L"receive-latency-target", coordinator.settings.receive_latency_target);
+        option (argc, argw, L"resumption-ticket-lifetime", raddi::protocol::resumption::lifetime);
 
         // option (argc, argw, L"", coordinator.settings.announcement_sample_size);
 
@@ -873,6 +945,9 @@ namespace {
                 workers = 1;
             }
         }
+        batches.assign (workers, 0);
+        drained = CreateEvent (NULL, FALSE, FALSE, NULL);
+
         for (auto i = 0uL; i != workers; ++i) {
             if (auto h = CreateThread (NULL, 0, worker, reinterpret_cast <LPVOID> ((std::size_t) i), 0, NULL)) {
                 CloseHandle (h);
@@ -1039,6 +1114,7 @@ namespace {
             CreateWaitableTimer (NULL, FALSE, NULL), // database disk flush
 
             CreateWaitableTimer (NULL, FALSE, NULL), // connections status
+            CreateWaitableTimer (NULL, FALSE, NULL), // delayed broadcasts dispatch
         };
 
         ScheduleTimerToLocalMidnight (events [2], +10'000'0);
@@ -1048,6 +1124,7 @@ namespace {
         }
 
         SetPeriodicWaitableTimer (events [6], database.settings.disk_flush_interval);
+        coordinator.dispatcher (events [8]);
         ScheduleWaitableTimer (events [7], 60 * 60'000'000'0uLL);
         SetEvent (optimize);
 
@@ -1084,6 +1161,7 @@ namespace {
                 //
                 case WAIT_OBJECT_0 + 1:
                     if (running) {
+                        drain ();
                         coordinator.sweep ();
                     }
                     goto case_WAIT_TIMEOUT;
@@ -1163,6 +1241,13 @@ namespace {
                     ScheduleWaitableTimer (events [7], 60 * 60'000'000'0uLL);
                     break;
 
+                // delayed broadcasts
+                //  - transmits entries whose randomized broadcast delay has elapsed
+                //
+                case WAIT_OBJECT_0 + 8:
+                    coordinator.dispatch ();
+                    break;
+
                 case WAIT_TIMEOUT:
                 case_WAIT_TIMEOUT:
                     
@@ -1186,8 +1271,8 @@ namespace {
                     //  - TODO: some database stats?
 
                     overview.set (L"connections", coordinator.active ());
-                    overview.set (L"transmitted", Transmitter::total.bytes);
-                    overview.set (L"received", Receiver::total.bytes);
+                    overview.set (L"transmitted", Transmitter::total.load ().bytes);
+                    overview.set (L"received", Receiver::total.load ().bytes);
                     overview.set (L"accepted", Listener::total.accepted);
                     overview.set (L"rejected", Listener::total.rejected);
                     overview.set (L"processed", source.total);
@@ -1206,9 +1291,14 @@ namespace {
         } while (InterlockedCompareExchange (&workers, 0, 0) != 0);
         SetThreadPriority (GetCurrentThread (), THREAD_PRIORITY_NORMAL);
 
+        coordinator.dispatcher (NULL);
         for (auto & event : events) {
             CloseHandle (event);
         }
+        if (drained) {
+            CloseHandle (drained);
+            drained = NULL;
+        }
 
         ::localhosts = nullptr;
         ::coordinator = nullptr;
@@ -1234,28 +1324,66 @@ namespace {
         raddi::log::note (3, i, id);
         ReleaseSemaphore (workclock, 1, NULL);
 
-        BOOL         success;
-        DWORD        n;
-        ULONG_PTR    key;
-        OVERLAPPED * overlapped;
-
+        bool running = true;
         do {
-            success = GetQueuedCompletionStatus (iocp, &n, &key, &overlapped, INFINITE);
-            if (overlapped) {
-                try {
-                    static_cast <Overlapped *> (overlapped)->completion (success, n);
-                    
-                } catch (const std::bad_alloc & x) {
-                    raddi::log::error (5, i, id, x.what ());
-                    SetEvent (optimize);
-                } catch (const std::exception & x) {
-                    raddi::log::error (6, i, id, x.what ());
-                } catch (...) {
-                    raddi::log::stop (7, i, id);
-                    terminate ();
+            if (pGetQueuedCompletionStatusEx) {
+                OVERLAPPED_ENTRY entries [completions_per_dequeue];
+                ULONG count = 0;
+
+                // batch starts before dequeuing, so that 'drain' doesn't miss completions
+                // this worker has already dequeued, but not yet started dispatching
+
+                InterlockedIncrement (&batches [i]);
+
+                if (pGetQueuedCompletionStatusEx (iocp, entries, completions_per_dequeue, &count, dequeue_timeout, FALSE)) {
+                    ULONG terminations = 0;
+
+                    for (ULONG e = 0; e != count; ++e) {
+                        const auto overlapped = entries [e].lpOverlapped;
+
+                        // status of the operation is in 'Internal', failure when not NT_SUCCESS
+
+                        BOOL success = TRUE;
+                        if (overlapped && ((LONG) overlapped->Internal < 0)) {
+                            success = FALSE;
+                            if (pRtlNtStatusToDosError) {
+                                SetLastError (pRtlNtStatusToDosError ((LONG) overlapped->Internal));
+                            }
+                        }
+                        if (!complete (i, id, success, entries [e].dwNumberOfBytesTransferred, entries [e].lpCompletionKey, overlapped)) {
+                            ++terminations;
+                        }
+                    }
+
+                    // every worker consumes exactly one termination packet, return the excess ones to others
+
+                    if (terminations) {
+                        while (--terminations) {
+                            PostQueuedCompletionStatus (iocp, 0, 0, NULL);
+                        }
+                        running = false;
+                    }
+                } else {
+                    if (GetLastError () != WAIT_TIMEOUT) {
+                        running = false;
+                    }
                 }
+
+                // batch is finished also after timeout or failure, with nothing dequeued
+
+                InterlockedIncrement (&batches [i]);
+                if (InterlockedCompareExchange (&draining, 0, 0)) {
+                    SetEvent (drained);
+                }
+            } else {
+                DWORD        n;
+                ULONG_PTR    key;
+                OVERLAPPED * overlapped;
+
+                BOOL success = GetQueuedCompletionStatus (iocp, &n, &key, &overlapped, INFINITE);
+                running = complete (i, id, success, n, key, overlapped);
             }
-        } while (overlapped || key || n);
+        } while (running);
 
         raddi::log::note (4, i, id);
         
@@ -1269,6 +1397,41 @@ namespace {
         return 0;
     }
 
+    void drain () {
+        std::vector <LONG> snapshot (batches.size ());
+        for (std::size_t i = 0; i != batches.size (); ++i) {
+            snapshot [i] = InterlockedCompareExchange (&batches [i], 0, 0);
+        }
+        InterlockedExchange (&draining, 1);
+        for (std::size_t i = 0; i != batches.size (); ++i) {
+            if (snapshot [i] & 1) {
+                while (InterlockedCompareExchange (&batches [i], 0, 0) == snapshot [i]) {
+                    WaitForSingleObject (drained, dequeue_timeout);
+                }
+            }
+        }
+        InterlockedExchange (&draining, 0);
+    }
+
+    bool complete (int i, DWORD id, BOOL success, DWORD n, ULONG_PTR key, OVERLAPPED * overlapped) {
+        if (overlapped) {
+            try {
+                static_cast <Overlapped *> (overlapped)->completion (success, n);
+
+            } catch (const std::bad_alloc & x) {
+                raddi::log::error (5, i, id, x.what ());
+                SetEvent (optimize);
+            } catch (const std::exception & x) {
+                raddi::log::error (6, i, id, x.what ());
+            } catch (...) {
+                raddi::log::stop (7, i, id);
+                terminate ();
+            }
+            return true;
+        } else
+            return key || n; // termination packet is all zeroes
+    }
+
     DWORD WINAPI handler (DWORD code, DWORD event, LPVOID data, LPVOID context) {
         if (code != SERVICE_CONTROL_INTERROGATE) {
             raddi::log::event (7, raddi::log::rsrc_string (0x00100 + code));
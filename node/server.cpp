@@ -134,8 +134,8 @@ namespace {
 
 // static data members live here
 
-counter Receiver::total;
-counter Transmitter::total;
+sharded_counter Receiver::total;
+sharded_counter Transmitter::total;
 Listener::Totals Listener::total;
 UdpPoint::Totals UdpPoint::total;
 
@@ -196,13 +196,11 @@ bool Receiver::accepted () {
     }
 }
 
-bool Receiver::next (std::uint16_t o) {
-    this->offset = o;
-
+bool Receiver::next () {
     DWORD flags = 0;
     WSABUF wsabuf = {
-        (ULONG) (65536 - o),
-        (char *) &this->buffer [0] + o
+        (ULONG) (Receiver::capacity - this->tail),
+        (char *) &this->buffer [this->tail]
     };
     return WSARecv (*this, &wsabuf, 1, NULL, &flags, this, NULL) == 0
         || GetLastError () == ERROR_IO_PENDING
@@ -210,6 +208,16 @@ bool Receiver::next (std::uint16_t o) {
 }
 
 void Receiver::completion (bool success, std::size_t n) {
+    if (this->suspension == 2) {
+
+        // resumption posted by 'resume', there was no receive pending
+        //  - if the socket was closed meanwhile, just disconnect
+
+        this->suspension = 0;
+        if (((SOCKET) *this != INVALID_SOCKET) && this->process ())
+            return;
+
+    } else
     if (success) {
         if (this->connecting) {
             this->connecting = false;
@@ -221,76 +229,171 @@ void Receiver::completion (bool success, std::size_t n) {
             this->counter += n;
             this->total += n;
             if (n) {
-                n += this->offset;
-
-            more:
-                std::size_t size = n;
-                if (this->inbound (&this->buffer [0], size)) {
-                    if (size == n) {
-                        if (this->next ())
-                            return;
-                    }
-                    if (size > n) {
-                        if (size < (1u << (CHAR_BIT * sizeof (this->offset)))) {
-                            if (this->next ((std::uint16_t) n))
-                                return;
-                        } else
-                            this->report (raddi::log::level::error, 0xA1F0, L"internal error"); // TODO, this catches 'offset' overflow
-                    }
-                    if (size < n) {
-                        // TODO: walk the buffer, don't pop-front until the last item
-                        //       no need to align, further 'decode' call decodes to aligned buffer
-                        std::memmove (&this->buffer [0], &this->buffer [size], 65536 - size); // pop front
-                        n -= size;
-                        goto more;
-                    }
-                }
+                this->tail += (std::uint32_t) n;
+
+                if (this->process ())
+                    return;
             }
         }
     }
     this->disconnected ();
 }
 
-// Transmitter
+bool Receiver::process () {
+    while (this->head != this->tail) {
+        const std::size_t available = this->tail - this->head;
 
-Transmitter::Transmitter (Socket && s)
-    : Socket (std::move (s)) {
+        std::size_t size = available;
+        if (!this->inbound (&this->buffer [this->head], size))
+            return false;
+
+        if (size > available) {
+            if (size < Receiver::capacity) {
+
+                // incomplete frame would not fit, move the remainder to the front
+                //  - no need to align, further 'decode' call decodes to aligned buffer
+
+                if (this->head + size > Receiver::capacity) {
+                    std::memmove (&this->buffer [0], &this->buffer [this->head], available);
+                    this->head = 0;
+                    this->tail = (std::uint32_t) available;
+                }
+                return this->next ();
+            } else {
+                this->report (raddi::log::level::error, 0xA1F0, L"internal error"); // TODO, this catches frame size overflow
+                return false;
+            }
+        }
+
+        // size <= available
+        //  - frame consumed, walk to the next one
 
-    this->pending.reserve (65536); // raddi::protocol::max_frame_size
+        this->head += (std::uint32_t) size;
+        if (this->head == this->tail) {
+            this->head = 0;
+            this->tail = 0;
+        }
+
+        if (size) {
+            if (const auto delay = this->throttle ()) {
+
+                // suspension is set first so that 'resume' can't be missed
+
+                this->suspension = 1;
+                if (this->suspended (delay))
+                    return true;
+
+                unsigned char expected = 1;
+                if (!this->suspension.compare_exchange_strong (expected, 0))
+                    return true; // already being resumed
+            }
+        }
+    }
+    return this->next ();
+}
+
+void Receiver::resume () noexcept {
+    unsigned char expected = 1;
+    if (this->suspension.compare_exchange_strong (expected, 2)) {
+        if (!this->enqueue ()) {
+            this->suspension = 1;
+            this->report (raddi::log::level::error, 17);
+        }
+    }
 }
 
+// Transmitter
+
+std::size_t Transmitter::limit = 32 * 1024 * 1024;
+
+Transmitter::Transmitter (Socket && s)
+    : Socket (std::move (s)) {}
+
 Transmitter::~Transmitter () {}
 
 void Transmitter::optimize () {
     exclusive guard (this->lock);
-    this->awaiting.shrink_to_fit ();
-    if (this->pending.empty () && this->pending.capacity () > 65536) {
-        this->pending.shrink_to_fit ();
-        this->pending.reserve (65536);
-    }
+    this->spare.clear ();
+    this->spare.shrink_to_fit ();
+    this->queue.shrink_to_fit ();
 }
 
-bool Transmitter::send (std::vector <unsigned char> & data) {
-    if (data.empty ())
+bool Transmitter::send () {
+    WSABUF wsabufs [Transmitter::max_chunks_per_send];
+    std::size_t bytes = 0;
+    DWORD n = 0;
+
+    for (const auto & chunk : this->queue) {
+        if (n == Transmitter::max_chunks_per_send)
+            break;
+
+        wsabufs [n].len = (ULONG) chunk.size ();
+        wsabufs [n].buf = (char *) chunk.data ();
+        bytes += chunk.size ();
+        ++n;
+    }
+
+    this->queued -= bytes;
+    this->sending = n;
+
+    if (n == 0)
         return true;
 
-    WSABUF wsabuf = { (unsigned long) data.size (), (char *) data.data () };
-    return WSASend (*this, &wsabuf, 1, NULL, 0, this, NULL) == 0
-        || GetLastError () == ERROR_IO_PENDING
-        || this->report (raddi::log::level::error, 5, data.size ());
+    if (WSASend (*this, wsabufs, n, NULL, 0, this, NULL) == 0 || GetLastError () == ERROR_IO_PENDING)
+        return true;
+
+    this->report (raddi::log::level::error, 5, bytes);
+
+    // failed chunks are dropped
+
+    this->recycle (this->sending);
+    this->sending = 0;
+    this->counters.dropped += bytes;
+    return false;
+}
+
+void Transmitter::recycle (std::size_t n) {
+    while (n-- && !this->queue.empty ()) {
+        if (this->spare.size () < 2) {
+            try {
+                this->spare.push_back (std::move (this->queue.front ()));
+                this->spare.back ().clear ();
+            } catch (const std::bad_alloc &) {
+                // not important
+            }
+        }
+        this->queue.pop_front ();
+    }
 }
 
 unsigned char * Transmitter::prepare (std::size_t size) {
     if ((SOCKET) *this != INVALID_SOCKET) {
+        if (size > Transmitter::chunk_size)
+            return nullptr;
+
+        if (this->unsynchronized_is_congested (size)) {
+            this->counters.congested += size;
+            return nullptr;
+        }
+
         try {
-            if (this->pending.empty ()) {
-                this->pending.resize (size);
-                return this->pending.data ();
-            } else {
-                const auto offset = this->awaiting.size ();
-                this->awaiting.resize (offset + size);
-                return this->awaiting.data () + offset;
+            if ((this->queue.size () == this->sending)
+                    || (this->queue.back ().size () + size > Transmitter::chunk_size)) {
+
+                if (!this->spare.empty ()) {
+                    this->queue.push_back (std::move (this->spare.back ()));
+                    this->spare.pop_back ();
+                } else {
+                    this->queue.emplace_back ();
+                    this->queue.back ().reserve (Transmitter::chunk_size);
+                }
             }
+
+            auto & chunk = this->queue.back ();
+            const auto offset = chunk.size ();
+            chunk.resize (offset + size);
+            return chunk.data () + offset;
+
         } catch (const std::bad_alloc &) {
             this->counters.oom += size;
         }
@@ -299,42 +402,45 @@ unsigned char * Transmitter::prepare (std::size_t size) {
 }
 
 bool Transmitter::transmit (const unsigned char * data, std::size_t size) {
-    try {
-        if (data == this->pending.data ()) {
-            this->pending.resize (size);
-            if (this->send (this->pending)) {
-                return true;
+    this->commit (data, size);
+    return this->flush ();
+}
 
-            } else {
-                this->counters.dropped += size;
-                this->pending.clear ();
-                return false;
-            }
-        } else {
-            const auto offset = data - this->awaiting.data ();
-            this->awaiting.resize (offset + size);
-            this->counters.delayed += size;
-            return true;
-        }
-    } catch (const std::bad_alloc &) {
-        this->counters.oom += size;
-        return false;
+void Transmitter::commit (const unsigned char * data, std::size_t size) {
+    auto & chunk = this->queue.back ();
+    const auto offset = data - chunk.data ();
+
+    chunk.resize (offset + size);
+    this->queued += size;
+
+    if (this->sending != 0) {
+        this->counters.delayed += size;
     }
 }
 
+bool Transmitter::flush () {
+    if (this->sending == 0) {
+        return this->send ();
+    } else
+        return true;
+}
+
 void Transmitter::completion (bool success, std::size_t n) {
+    exclusive guard (this->lock);
+
+    if (success) {
+        this->replenish ();
+    }
+
+    this->recycle (this->sending);
+    this->sending = 0;
+
     if (success) {
         this->total += n;
         this->counters.sent += n;
 
-        exclusive guard (this->lock);
-        this->pending.clear ();
-        if (!this->awaiting.empty ()) {
-            if (this->send (this->awaiting)) {
-                this->pending.swap (this->awaiting);
-            } else {
-                this->counters.dropped += n;
-            }
+        if (!this->queue.empty ()) {
+            this->send ();
         }
     } else {
         this->counters.dropped += n;
@@ -375,6 +481,7 @@ void Connection::terminate () noexcept {
     this->Transmitter::cancel ((HANDLE) (SOCKET) *this);
     this->Receiver::cancel ((HANDLE) (SOCKET) *this);
     this->Socket::disconnect ();
+    this->Receiver::resume ();
 }
 
 // Listener
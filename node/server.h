@@ -6,6 +6,8 @@
 #include <mswsock.h>
 #include <cwchar>
 #include <vector>
+#include <deque>
+#include <atomic>
 
 #include "sodium.h"
 #include "../common/lock.h"
@@ -70,16 +72,52 @@ class Transmitter
     , virtual Socket
     , virtual raddi::log::provider <raddi::component::server> {
 
-    std::vector <unsigned char> pending;
-    std::vector <unsigned char> awaiting;
+    // queue
+    //  - chain of fixed-size chunks, frames are encoded directly into the last one
+    //  - first 'sending' chunks are currently being transmitted by single WSASend call
+    //
+    std::deque <std::vector <unsigned char>> queue;
+    std::size_t sending = 0;
+    std::size_t queued = 0; // bytes in chunks not yet being transmitted
+
+    // spare
+    //  - few released chunks kept for reuse to avoid reallocations
+    //
+    std::vector <std::vector <unsigned char>> spare;
 
     void completion (bool success, std::size_t n) override;
-    bool send (std::vector <unsigned char> &);
+    bool send ();
+    void recycle (std::size_t n);
+
+protected:
+
+    // replenish
+    //  - called, under lock, when previous transmission completes and before the next one
+    //    is initiated, derived class can prepare/transmit additional data
+    //
+    virtual void replenish () {};
 
 public:
     Transmitter (Socket &&);
     virtual ~Transmitter () = 0;
 
+    // chunk_size
+    //  - size of a single buffer in the chain, every frame must fit into one
+    //
+    static constexpr std::size_t chunk_size = 65536; // raddi::protocol::max_frame_size + 1
+
+    // max_chunks_per_send
+    //  - maximum number of buffers (WSABUFs) passed to a single WSASend call
+    //
+    static constexpr std::size_t max_chunks_per_send = 16;
+
+    // limit
+    //  - maximum number of bytes queued for transmission (not yet passed to WSASend),
+    //    'prepare' fails when exceeded and the connection is considered congested
+    //  - zero means unlimited
+    //
+    static std::size_t limit;
+
     // optimize
     //  - releases as much memory as possible
     //  - requires synchronization thus don't request optimization for non-secured connections
@@ -94,14 +132,33 @@ public:
     unsigned char * prepare (std::size_t size);
     bool transmit (const unsigned char * prepared, std::size_t size);
 
+    // commit/flush
+    //  - 'transmit' split in two, 'commit' only appends prepared data without initiating
+    //    the transmission, 'flush' then passes everything committed to a single WSASend
+    //
+    void commit (const unsigned char * prepared, std::size_t size);
+    bool flush ();
+
     bool unsynchronized_is_live () const noexcept {
-        return !this->awaiting.empty ()
-            && !this->pending.empty ();
+        return this->sending != 0
+            && this->queue.size () > this->sending;
+    }
+
+    // unsynchronized_is_congested
+    //  - returns true when 'size' more bytes wouldn't fit into transmission queue 'limit'
+    //  - the same condition on which 'prepare' fails
+    //
+    bool unsynchronized_is_congested (std::size_t size = 1) const noexcept {
+        return Transmitter::limit
+            && this->queued + size > Transmitter::limit;
     }
 
     std::size_t buffer_size () const {
         immutability guard (this->lock);
-        return this->awaiting.size ();
+        return this->queued;
+    }
+    std::size_t unsynchronized_buffer_size () const noexcept {
+        return this->queued;
     }
 
 public:
@@ -110,9 +167,10 @@ public:
         counter dropped;
         counter sent;
         counter oom;
+        counter congested;
     } counters;
 
-    static counter total;
+    static sharded_counter total;
 };
 
 class Receiver
@@ -120,14 +178,30 @@ class Receiver
     , virtual Socket
     , virtual raddi::log::provider <raddi::component::server> {
 
+    // buffer
+    //  - 64 kB window, received data are between 'head' and 'tail'
+    //  - frames are consumed by advancing 'head', no data are moved until the last,
+    //    incomplete frame would not fit to the end of the buffer (then it's moved to front)
+    //
     std::uint8_t *  buffer = nullptr;
-    std::uint16_t   offset = 0;
+    std::uint32_t   head = 0;
+    std::uint32_t   tail = 0;
+
+    static constexpr std::uint32_t capacity = 65536;
+
+    // suspension
+    //  - receiving suspended by 'throttle', data wait in the buffer until 'resume'
+    //  - 0 = receiving, 1 = suspended, 2 = resumption posted to the completion port
+    //
+    std::atomic <unsigned char> suspension { 0 };
+
 protected:
     bool            connecting = true;
 
 private:
     void completion (bool success, std::size_t n) override;
-    bool next (std::uint16_t offset = 0);
+    bool process ();
+    bool next ();
     
     // inbound
     //  - returning false results in connection disconnecting
@@ -141,6 +215,18 @@ private:
     virtual void overloaded () = 0;
     virtual void disconnected () = 0;
 
+    // throttle
+    //  - called after every consumed frame
+    //  - returns number of microseconds to suspend receiving and processing for, 0 to continue
+    //
+    virtual std::uint64_t throttle () = 0;
+
+    // suspended
+    //  - receiving was suspended, the implementation must arrange for 'resume' to be called
+    //    after 'delay' microseconds, returning false continues immediately
+    //
+    virtual bool suspended (std::uint64_t delay) = 0;
+
 protected:
     Receiver (Socket &&);
     ~Receiver ();
@@ -160,13 +246,26 @@ protected:
     //
     bool accepted ();
 
+    // resume
+    //  - continues processing buffered data and receiving after 'suspended'
+    //  - posts completion to the thread-pool, does nothing if not suspended
+    //
+    void resume () noexcept;
+
+    // paused
+    //  - receiving is suspended, and no receive is pending, but completion may be
+    //
+    bool paused () const noexcept {
+        return this->suspension != 0;
+    }
+
     // counter
     //  - number of fragments and total size of received data on the socket
     //
     counter counter;
 
 public:
-    static struct counter total;
+    static sharded_counter total;
 };
 
 class Connection
@@ -181,12 +280,14 @@ protected:
 
     bool pending () const noexcept {
         return this->Receiver::Overlapped::pending ()
+            || this->Receiver::paused ()
             || this->Transmitter::Overlapped::pending ();
     }
     bool connect (const SOCKADDR_INET & peer);
     void terminate () noexcept;
 
     using Transmitter::buffer_size;
+    using Receiver::resume;
 };
 
 class Listener
@@ -259,8 +360,8 @@ public:
 
 public:
     static struct Totals {
-        counter received;
-        counter sent;
+        sharded_counter received;
+        sharded_counter sent;
     } total;
 };
 